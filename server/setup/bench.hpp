@@ -0,0 +1,68 @@
+// bench_calc.cpp と bench_datalink.cpp で共通の計測
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// 計測した処理の結果を捨てられないようにここに足し込む
+inline volatile long long bench_sink = 0;
+
+// 各ベンチマークを最低 min_runs 回かつ合計 min_seconds 秒以上繰り返し,1回あたりの時間の最小値と中央値を出力する
+// items は1回の実行で処理する要素の数で,中央値の時間から1秒あたりの処理数を出す
+struct Bench {
+  double min_seconds = 1.0;
+  int min_runs = 3;
+
+  // ./bench_xxx <入力> [--time <seconds>] [--runs <n>] の共通のオプションを読む
+  // 入力のファイル名を返す
+  const char *parse_args(int argc, char *argv[]){
+    const char *input_file = nullptr;
+    for(int i = 1; i < argc; i++){
+      const std::string arg = argv[i];
+      if(arg == "--time" && i+1 < argc){
+        min_seconds = std::atof(argv[++i]);
+      }else if(arg == "--runs" && i+1 < argc){
+        min_runs = std::max(1, std::atoi(argv[++i]));
+      }else if(arg[0] != '-' && !input_file){
+        input_file = argv[i];
+      }else{
+        std::fprintf(stderr, "Error: invalid argument %s\n", arg.c_str());
+        std::exit(1);
+      }
+    }
+    if(!input_file){
+      std::fprintf(stderr, "Error: no input file\n");
+      std::exit(1);
+    }
+    return input_file;
+  }
+
+  // setup() は計測の外で毎回呼ぶ(入力を書き換える処理のために元のデータを戻す)
+  template<class Setup, class F>
+  void run(const char *name, const long long items, const char *unit, Setup setup, F body) const{
+    using clock = std::chrono::steady_clock;
+    std::vector<double> times;
+    double total = 0;
+    while((int)times.size() < min_runs || total < min_seconds){
+      setup();
+      const auto start = clock::now();
+      bench_sink = bench_sink + body();
+      const double t = std::chrono::duration<double>(clock::now() - start).count();
+      times.push_back(t);
+      total += t;
+    }
+    std::sort(times.begin(), times.end());
+    const double median = times[times.size() / 2];
+    std::printf("%-28s %6d runs  min %10.3f ms  median %10.3f ms  %14.0f %s/s\n",
+      name, (int)times.size(), times.front() * 1e3, median * 1e3, items / median, unit);
+    std::fflush(stdout);
+  }
+
+  template<class F>
+  void run(const char *name, const long long items, const char *unit, F body) const{
+    run(name, items, unit, [](){}, body);
+  }
+};
@@ -0,0 +1,39 @@
+// calc と datalink のベンチマークを合成したデータで実行する
+//   node bench.js [--scale <路線の数>] [--seed <n>] [--time <seconds>]
+// 同じ scale と seed なら同じデータになるので,変更の前後で結果を比べられる
+const { execSync } = require("child_process");
+const { generate_bench_data } = require("./gen-bench-data");
+
+const options = { scale: 100, seed: 1, time: 1 };
+const args = process.argv.slice(2);
+for (let i = 0; i < args.length; i++) {
+  const name = args[i].replace(/^--/, "");
+  if (!(name in options) || i + 1 >= args.length) {
+    console.error(`Error: invalid argument ${args[i]}`);
+    process.exit(1);
+  }
+  options[name] = +args[++i];
+}
+
+const dir = "data/bench";
+const run = (command) => {
+  try {
+    execSync(command, { stdio: "inherit" });
+  } catch (err) {
+    console.error(`Error: ${command} failed`);
+    process.exit(1);
+  }
+};
+
+console.log(`Create bench data (scale ${options.scale}, seed ${options.seed}) & Compile`);
+generate_bench_data(dir, options.scale, options.seed);
+// create.js が使う data/calc は上書きしない
+run(`g++ calc.cpp -o ${dir}/calc -O2 -pthread`);
+run(`g++ bench_calc.cpp -o ${dir}/bench_calc -O2 -std=c++17 -pthread`);
+run(`g++ bench_datalink.cpp -o ${dir}/bench_datalink -O2 -std=c++17`);
+run(`./${dir}/calc --convert ${dir}/railroad.bin < ${dir}/railroad.txt`);
+
+console.log("calc");
+run(`./${dir}/bench_calc ${dir}/railroad.bin --time ${options.time}`);
+console.log("datalink");
+run(`./${dir}/bench_datalink ${dir}/input.txt --time ${options.time}`);
@@ -0,0 +1,69 @@
+// calc の隣駅の計算のベンチマーク
+//   ./bench_calc <railroad.bin> [--time <seconds>] [--runs <n>]
+// railroad.bin は gen-bench-data.js の railroad.txt を calc --convert で変換したもの(bench.js が作る)
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include "next_station.hpp"
+#include "railroad_bin.hpp"
+#include "bench.hpp"
+
+int main(int argc, char *argv[]){
+  Bench bench;
+  const char *input_file = bench.parse_args(argc, argv);
+  std::ifstream ifs(input_file, std::ios::binary);
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  const std::string data = ss.str();
+  NextStationContext ctx;
+  if(const char *reason = read_railroad_bin(ctx, data.data(), data.size())){
+    std::cerr << "Error: " << input_file << " is not a valid railroad.bin (" << reason << ")\n";
+    return 1;
+  }
+  ctx.prepare();
+
+  long long station_num = ctx.stations.size();
+  long long path_num = 0;
+  for(const auto &paths : ctx.railway_paths) path_num += paths.size();
+  std::printf("%d railways, %lld stations, %lld paths\n", ctx.railway_num, station_num, path_num);
+
+  // search_next_station は path を書き換えるので毎回コピーし直す
+  std::vector<std::vector<Path>> paths;
+  bench.run("search_next_station", station_num, "stations", [&](){
+    paths = ctx.railway_paths;
+  }, [&](){
+    long long expanded = 0;
+    for(int id = 0; id < ctx.railway_num; id++){
+      std::vector<NextStaInfo> next_station_data;
+      expanded += search_next_station(ctx.stations_by_railway[id], next_station_data, paths[id], ctx.snap_tolerance);
+    }
+    return expanded;
+  });
+
+  // 分岐のある連結成分だけを取り出しておく
+  std::vector<std::vector<NextStaInfo>> branch_graphs;
+  long long branch_station_num = 0;
+  for(int id = 0; id < ctx.railway_num; id++){
+    std::vector<NextStaInfo> next_station_data;
+    std::vector<Path> railway_paths = ctx.railway_paths[id];
+    search_next_station(ctx.stations_by_railway[id], next_station_data, railway_paths, ctx.snap_tolerance);
+    for(auto &graph : separate_to_connected_graph(std::move(next_station_data))){
+      if(find_railway_type(graph) != RailwayType::WithBranches) continue;
+      branch_station_num += graph.size();
+      branch_graphs.push_back(std::move(graph));
+    }
+  }
+  std::vector<std::vector<NextStaInfo>> graphs;
+  bench.run("calc_with_branches_graph", branch_station_num, "stations", [&](){
+    graphs = branch_graphs;
+  }, [&](){
+    for(auto &graph : graphs) calc_with_branches_graph(graph);
+    return (long long)graphs.size();
+  });
+
+  bench.run("calculate_next_station", station_num, "stations", [&](){
+    long long count = 0;
+    for(int id = 0; id < ctx.railway_num; id++) count += ctx.calculate_next_station(id).size();
+    return count;
+  });
+}
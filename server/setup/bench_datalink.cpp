@@ -0,0 +1,62 @@
+// datalink の対応付けのベンチマーク
+//   ./bench_datalink <input.txt> [--time <seconds>] [--runs <n>]
+// input.txt は gen-bench-data.js で作ったもの(collect-data.js の出力と同じ形式)
+#define DATALINK_NO_MAIN
+#include "datalink.cpp"
+#include "bench.hpp"
+
+int main(int argc, char *argv[]){
+  Bench bench;
+  const char *input_file = bench.parse_args(argc, argv);
+  FILE *fp = std::fopen(input_file, "rb");
+  if(!fp){
+    std::cerr << "Error: " << input_file << " does not exist\n";
+    return 1;
+  }
+  {
+    Scanner sc(fp);
+    get_station_data(sc, ekispert_data);
+    get_station_data(sc, eki_data);
+    get_station_data(sc, kokudo_route_data);
+  }
+  std::fclose(fp);
+  eki_data.build();
+  ekispert_data.build();
+  kokudo_route_data.build();
+  std::printf("%d + %d stations, %d + %d railways\n",
+    (int)eki_data.stations.size(), (int)ekispert_data.stations.size(), (int)eki_data.railways.size(), (int)ekispert_data.railways.size());
+
+  // 路線名どうしの全ての組(link_stations_name と同じく文字の列にしたもので比べる)
+  std::vector<std::pair<const std::u32string*, const std::u32string*>> name_pairs;
+  for(const auto &railway : eki_data.railways){
+    for(const auto &rail : ekispert_data.railways) name_pairs.emplace_back(&railway.name_chars, &rail.name_chars);
+  }
+  bench.run("str_dist", name_pairs.size(), "pairs", [&](){
+    long long sum = 0;
+    for(const auto &[s, t] : name_pairs) sum += str_dist(*s, *t);
+    return sum;
+  });
+
+  std::vector<std::pair<int, int>> main_sub_station_pairs;
+  std::vector<const Station*> unknown_stations;
+  bench.run("link_stations_name", eki_data.stations.size(), "stations", [&](){
+    main_sub_station_pairs.clear();
+    unknown_stations.clear();
+  }, [&](){
+    link_stations_name(main_sub_station_pairs, unknown_stations);
+    return (long long)main_sub_station_pairs.size();
+  });
+
+  // link_railways_color は路線の駅の並びを書き換えるので毎回作り直す
+  std::vector<std::pair<int, int>> main_sub_railway_pairs;
+  std::vector<const Railway*> unknown_railways;
+  bench.run("link_railways_color", eki_data.railways.size(), "railways", [&](){
+    eki_data.build();
+    ekispert_data.build();
+    main_sub_railway_pairs.clear();
+    unknown_railways.clear();
+  }, [&](){
+    link_railways_color(main_sub_railway_pairs, unknown_railways, main_sub_station_pairs);
+    return (long long)main_sub_railway_pairs.size();
+  });
+}
@@ -0,0 +1,18 @@
+{
+  "targets": [
+    {
+      "target_name": "next_station",
+      "sources": ["next_station_addon.cpp"],
+      "cflags_cc": ["-O2", "-std=c++17", "-fexceptions"],
+      "cflags_cc!": ["-fno-exceptions"],
+      "conditions": [
+        ["OS=='linux'", { "libraries": ["-ldl"] }]
+      ],
+      "xcode_settings": {
+        "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+        "GCC_OPTIMIZATION_LEVEL": "2",
+        "GCC_ENABLE_CPP_EXCEPTIONS": "YES"
+      }
+    }
+  ]
+}
@@ -2,770 +2,449 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
-#include <cmath>
-#include <queue>
-#include <map>
-#include <cassert>
-
-constexpr double PI = 3.14159265358979323846;
-
-struct UnionFind {
-  std::vector<int> d;
-  UnionFind(int n): n(n), d(n, -1){}
-  int root(int x){
-    assert(0 <= x && x < n);
-    if(d[x] < 0) return x;
-    return d[x] = root(d[x]);
-  }
-  bool unite(int x, int y){
-    x = root(x);
-    y = root(y);
-    if(x == y) return false;
-    if(d[x] > d[y]) std::swap(x, y);
-    d[x] += d[y];
-    d[y] = x;
-    return true;
-  }
-  bool same(int x, int y){
-    return root(x) == root(y);
-  }
-  int size(int x){
-    return -d[root(x)];
-  }
-private:
-  int n;
-};
-
-double get_double(){
-  int a; char c; int b;
-  std::cin >> a >> c >> b;
-  return a + b * 1e-5;
-}
-
-struct Pos {
-  double lat,lng;
-  Pos() : lat(0), lng(0){}
-  Pos(const double a, const double b) : lat(a), lng(b){}
-  double dist_km(const Pos &a) const{
-    static constexpr double R = PI / 180;
-    return acos(cos(lat*R) * cos(a.lat*R) * cos(a.lng*R - lng*R) + sin(lat*R) * sin(a.lat*R)) * 6371;
-  }
-  double dist(const Pos &a) const{
-    return sqrt((lat-a.lat)*(lat-a.lat) + (lng-a.lng)*(lng-a.lng));
-  }
-  inline constexpr bool operator<(const Pos &a) const{
-    if(lat != a.lat) return lat < a.lat;
-    return lng < a.lng;
-  }
-  inline constexpr bool operator==(const Pos &a) const{
-    return lat == a.lat && lng == a.lng;
-  }
-  inline Pos operator-(const Pos &a) const{
-    return Pos(lat-a.lat, lng-a.lng);
-  }
-  inline constexpr double dot(const Pos &a) const{
-    return lat*a.lat + lng*a.lng;
-  }
-  inline constexpr double cross(const Pos &a) const{
-    return lat*a.lng - lng*a.lat;
-  }
-  inline constexpr double abs() const{
-    return sqrt(lat*lat + lng*lng);
-  }
-  inline constexpr double arg_cos(const Pos &a) const{
-    return (dot(a) / (abs() * a.abs()));
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "scanner.hpp"
+#include "next_station.hpp"
+#include "railroad_bin.hpp"
+#include "stats.hpp"
+#include "result_cache.hpp"
+
+struct MappedFile {
+  const char *data;
+  size_t size;
+  explicit MappedFile(const char *file_path) : data(nullptr), size(0){
+    const int fd = open(file_path, O_RDONLY);
+    if(fd < 0){
+      std::cerr << "Error: " << file_path << " does not exist\n";
+      std::exit(1);
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0){
+      std::cerr << "Error: cannot stat " << file_path << "\n";
+      std::exit(1);
+    }
+    size = st.st_size;
+    if(size){
+      void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(ptr == MAP_FAILED){
+        std::cerr << "Error: cannot mmap " << file_path << "\n";
+        std::exit(1);
+      }
+      data = static_cast<const char*>(ptr);
+    }
+    close(fd);
   }
-  inline constexpr double arg() const{
-    return atan2(lng, lat);
+  ~MappedFile(){
+    if(data) munmap(const_cast<char*>(data), size);
   }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile &operator=(const MappedFile&) = delete;
 };
 
-using Path = std::vector<Pos>;
-
-Pos get_coordinate(){
-  const double lat = get_double();
-  const double lng = get_double();
+Pos get_coordinate(Scanner &sc){
+  const double lat = sc.get_double();
+  const double lng = sc.get_double();
   return Pos(lat, lng);
 }
 
-struct Station {
-  std::vector<Path> geometry;
-  int station_code, railway_id;
-  std::string railway_name, railway_company, station_name;
-  Station(const std::vector<Path> &g, const int s, const int r, const std::string &rn, const std::string &rc, const std::string &sn) :
-    geometry(g), station_code(s), railway_id(r), railway_name(rn), railway_company(rc), station_name(sn){}
-};
-
-enum class RailwayType {
-  LinearList,
-  Circle,
-  WithLoop,
-  WithBranches,
-  None,
-};
+int thread_num = 1;
 
-struct NextStaInfo {
-  const Station station;
-  int index;
-  std::vector<int> left, right;
-  NextStaInfo(const Station &sta, const int idx, const std::vector<int> &dir1, const std::vector<int> &dir2) :
-    station(sta), index(idx), left(dir1), right(dir2){}
-
-  std::vector<int> next_list() const{
-    std::vector<int> temp = left;
-    temp.insert(temp.end(), right.begin(), right.end());
-    return temp;
-  }
-  inline int size() const{
-    return left.size() + right.size();
-  }
-};
-
-int railway_num;
-std::vector<Station> stations;
-std::vector<std::vector<Path>> railway_paths;
-
-void input(){
-  int station_num, path_num;
-  std::cin >> station_num >> railway_num;
+void input(NextStationContext &ctx){
+  Scanner sc;
+  const int station_num = sc.get_int();
+  ctx.railway_num = sc.get_int();
+  ctx.stations.reserve(station_num);
   for(int i = 0; i < station_num; i++){
-    int line_num;
-    std::cin >> line_num;
+    const int line_num = sc.get_int();
     std::vector<Path> geo(line_num);
     for(int j = 0; j < line_num; j++){
-      int num;
-      std::cin >> num;
+      const int num = sc.get_int();
+      geo[j].reserve(num);
       for(int k = 0; k < num; k++){
-        geo[j].push_back(get_coordinate());
+        geo[j].push_back(get_coordinate(sc));
       }
     }
-    int code, id;
-    std::string railway_name, company, station_name;
-    std::cin >> code >> id >> railway_name >> company >> station_name;
-    stations.emplace_back(geo, code, id, railway_name, company, station_name);
+    const int code = sc.get_int();
+    const int id = sc.get_int();
+    std::string railway_name = sc.get_string();
+    std::string company = sc.get_string();
+    std::string station_name = sc.get_string();
+    ctx.stations.emplace_back(std::move(geo), code, id, std::move(railway_name), std::move(company), std::move(station_name));
   }
 
-  std::cin >> path_num;
-  railway_paths.resize(railway_num);
+  const int path_num = sc.get_int();
+  ctx.railway_paths.resize(ctx.railway_num);
   for(int i = 0; i < path_num; i++){
-    int id, num;
-    std::cin >> id >> num;
+    const int id = sc.get_int();
+    const int num = sc.get_int();
     Path path;
+    path.reserve(num);
     for(int j = 0; j < num; j++){
-      path.push_back(get_coordinate());
-    }
-    railway_paths[id].push_back(path);
-  }
-
-  for(auto &path : railway_paths){
-    std::sort(path.begin(), path.end());
-    path.erase(std::unique(path.begin(), path.end()), path.end());
-  }
-}
-
-void search_next_station(const std::vector<Station> &railway_stations, std::vector<NextStaInfo> &next_station_data, std::vector<Path> &paths){
-  const int path_num = paths.size();
-  // データに記述されていない交点を探す
-  for(int i = 0; i < path_num; i++){
-    for(const Pos &pos : Path{ paths[i][0], paths[i].back() }){
-      for(int j = 0; j < path_num; j++) if(i != j){
-        const auto &path = paths[j];
-        bool through = false;
-        for(const Pos &p : path) if(p == pos){
-          through = true;
-          break;
-        }
-        if(through) break;
-        for(int k = 0; k < (int)path.size()-1; k++){
-          if((path[k+1]-path[k]).dot(pos-path[k]) < 0) continue;
-          if((path[k]-path[k+1]).dot(pos-path[k+1]) < 0) continue;
-          const double d = std::abs((path[k+1]-path[k]).cross(pos-path[k]) / (path[k+1]-path[k]).abs());
-          if(d < 1e-6){
-            auto &sep_path = paths[j];
-            paths.emplace_back(sep_path.begin() + k, sep_path.end());
-            paths.back()[0] = pos;
-            sep_path.erase(sep_path.begin() + k+1, sep_path.end());
-            sep_path.push_back(pos);
-            through = true;
-            break;
-          }
-        }
-        if(through) break;
-      }
-    }
-  }
-
-  // build graph
-  std::vector<Pos> pos_data;
-  std::map<Pos, int> index;
-  std::vector<std::vector<int>> root;
-  std::vector<int> path_kinds_num;
-  for(const auto &path : paths){
-    int prev_idx = -1;
-    for(const Pos &p : path){
-      if(!index.count(p)){
-        index[p] = (int)pos_data.size();
-        pos_data.push_back(p);
-        root.push_back({});
-        path_kinds_num.push_back(0);
-      }
-      const int idx = index[p];
-      if(prev_idx != -1){
-        root[idx].push_back(prev_idx);
-        root[prev_idx].push_back(idx);
-      }
-      path_kinds_num[idx]++;
-      prev_idx = idx;
-    }
-  }
-  // 特定のX状のpathを分離する
-  for(int i = 0; i < (int)root.size(); i++){
-    if((int)root[i].size() != 4) continue;
-    if(path_kinds_num[i] >= 4) continue;
-    // 分離
-    const int last = root.size();
-    for(int &x : root[root[i][2]]){
-      if(x == i) x = last;
-    }
-    for(int &x : root[root[i][3]]){
-      if(x == i) x = last;
-    }
-    root.push_back({ root[i][2], root[i][3] });
-    root[i].pop_back(); root[i].pop_back();
-    pos_data.push_back(pos_data[i]);
-  }
-
-  const int station_num = railway_stations.size();
-  std::vector<std::vector<int>> station_indices(station_num);
-  for(int i = 0; i < station_num; i++){
-    for(const auto &path : railway_stations[i].geometry){
-      const Pos middle = path[path.size() / 2];
-      double min_dist = 1e9;
-      int min_idx = -1;
-      for(int j = 0; j < (int)pos_data.size(); j++){
-        const double d = middle.dist(pos_data[j]);
-        if(min_dist > d){
-          min_dist = d;
-          min_idx = j;
-        }
-      }
-      station_indices[i].push_back(min_idx);
-    }
-  }
-
-  // 駅がある頂点をメモ
-  std::vector<int> has_station(root.size(), -1);
-  for(int i = 0; i < station_num; i++){
-    for(const int idx : station_indices[i]){
-      has_station[idx] = i;
-    }
-  }
-
-  // 先端まで何もないpathを削除する,スイッチバックがある程度解決される
-  for(int i = 0; i < (int)root.size(); i++){
-    int p = i;
-    while((int)root[p].size() == 1 && has_station[p] < 0){
-      const int nxt = root[p][0];
-      root[p].clear();
-      root[nxt].erase(std::remove_if(root[nxt].begin(), root[nxt].end(), [&p](const int i){
-        return i == p; // filter
-      }), root[nxt].end());
-      p = nxt;
-    }
-  }
-
-  // ひとつずつ探索していく
-  for(int i = 0; i < station_num; i++){
-    std::vector<int> next_stations;
-    std::vector<int> visited(root.size(), -1);
-    std::vector<int> prev(root.size(), -1);
-    std::queue<int> que;
-    for(const int idx : station_indices[i]){
-      visited[idx] = 0;
-      que.push(idx);
-    }
-    while(!que.empty()){
-      const int pos = que.front();
-      que.pop();
-      for(const int x : root[pos]){
-        if(visited[x] != -1) continue;
-        if(prev[pos] < 0 || (int)root[pos].size() == 2 || ((pos_data[x]-pos_data[pos]).arg_cos(pos_data[prev[pos]]-pos_data[pos])) < 0.33){
-          visited[x] = visited[pos] + 1;
-          prev[x] = pos;
-          if(has_station[x] < 0 || has_station[x] == i) que.push(x);
-          else next_stations.push_back(x);
-        }
-      }
-    }
-    // next stationsの方向を計算
-    const int next_num = next_stations.size();
-    std::vector<double> args(next_num);
-    for(int j = 0; j < next_num; j++){
-      int p = next_stations[j];
-      while(prev[prev[p]] != -1) p = prev[p];
-      args[j] = (pos_data[p] - pos_data[prev[p]]).arg();
-    }
-    std::vector<int> dir1_next_stations, dir2_next_stations;
-    if(next_num){
-      for(int j = 0; j < next_num; j++){
-        if(abs(args[0] - args[j]) < 0.1 || abs(PI*2 - abs(args[0] - args[j])) < 0.1){
-          dir1_next_stations.push_back(has_station[next_stations[j]]);
-        }else{
-          dir2_next_stations.push_back(has_station[next_stations[j]]);
-        }
-      }
-      std::sort(dir1_next_stations.begin(), dir1_next_stations.end());
-      dir1_next_stations.erase(std::unique(dir1_next_stations.begin(), dir1_next_stations.end()), dir1_next_stations.end());
-      std::sort(dir2_next_stations.begin(), dir2_next_stations.end());
-      dir2_next_stations.erase(std::unique(dir2_next_stations.begin(), dir2_next_stations.end()), dir2_next_stations.end());
-    }
-    next_station_data.emplace_back(railway_stations[i], i, dir1_next_stations, dir2_next_stations);
-  }
-}
-
-std::vector<std::vector<NextStaInfo>> separate_to_connected_graph(const std::vector<NextStaInfo> &next_station_data){
-  const int station_num = next_station_data.size();
-  UnionFind tree(station_num);
-  for(const auto &data : next_station_data){
-    for(const auto &sta : data.next_list()){
-      tree.unite(data.index, sta);
-    }
-  }
-  if(tree.size(0) == station_num){
-    return { next_station_data };
-  }
-
-  std::map<int, std::vector<NextStaInfo>> group;
-  for(const auto &data : next_station_data){
-    group[tree.root(data.index)].push_back(data);
-  }
-  std::vector<std::vector<NextStaInfo>> next_station_graph_data;
-  for(const auto &elem : group){
-    std::map<int, int> indices;
-    int count = 0;
-    for(const auto &data : elem.second){
-      indices[data.index] = count;
-      count++;
-    }
-    std::vector<NextStaInfo> compressed_data;
-    for(const auto &data : elem.second){
-      NextStaInfo info = data;
-      info.index = indices[info.index];
-      for(int &x : info.left) x = indices[x];
-      for(int &x : info.right) x = indices[x];
-      compressed_data.push_back(info);
-    }
-    next_station_graph_data.push_back(compressed_data);
-  }
-  return next_station_graph_data;
-}
-
-std::vector<NextStaInfo> calc_linear_list_graph(std::vector<NextStaInfo> graph){
-  const int station_num = graph.size();
-  std::vector<int> start_cands;
-  for(int i = 0; i < station_num; i++){
-    if((int)graph[i].size() != 1) continue;
-    start_cands.emplace_back(i);
-  }
-  assert(!start_cands.empty());
-  int cur = start_cands[0];
-  for(const int idx : start_cands){
-    if(graph[cur].station.geometry[0][0].lng > graph[idx].station.geometry[0][0].lng){
-      cur = idx;
-    }
-  }
-  if((int)start_cands.size() == 2){
-    const auto pos0 = graph[start_cands[0]].station.geometry[0][0];
-    const auto pos1 = graph[start_cands[1]].station.geometry[0][0];
-    if(std::abs(pos0.lat - pos1.lat) < std::abs(pos0.lng - pos1.lng)){
-      if(pos0.lng < pos1.lng) cur = start_cands[0];
-      else cur = start_cands[1];
-    }else{
-      if(pos0.lat < pos1.lat) cur = start_cands[0];
-      else cur = start_cands[1];
+      path.push_back(get_coordinate(sc));
     }
+    ctx.railway_paths[id].push_back(std::move(path));
   }
-  int prev = -1;
-  while(prev == -1 || (int)graph[cur].size() == 2){
-    for(const int x : graph[cur].next_list()){
-      if(x == prev) continue;
-      if(prev != -1) graph[cur].left = { prev };
-      else graph[cur].left = {};
-      graph[cur].right = { x };
-      prev = cur;
-      cur = x;
-      break;
-    }
-  }
-  graph[cur].left = { prev };
-  graph[cur].right = {};
-  return graph;
 }
 
-std::vector<NextStaInfo> calc_circle_graph(std::vector<NextStaInfo> graph){
-  int cur = graph[0].next_list()[0], prev = 0;
-  graph[0].right = { cur };
-  while(cur != 0){
-    for(const int x : graph[cur].next_list()){
-      if(x == prev) continue;
-      graph[cur].left = { prev };
-      graph[cur].right = { x };
-      prev = cur;
-      cur = x;
-      break;
-    }
+// railroad.bin から読み込む
+void input_binary(NextStationContext &ctx, const char *file_path){
+  const MappedFile file(file_path);
+  if(const char *reason = read_railroad_bin(ctx, file.data, file.size)){
+    std::cerr << "Error: " << file_path << " is not a valid railroad.bin (" << reason << ")\n";
+    std::exit(1);
   }
-  graph[0].left = { prev };
-  return graph;
 }
 
-std::vector<NextStaInfo> calc_with_loop_graph(std::vector<NextStaInfo> graph){
-  const int station_num = graph.size();
-  int st = -1;
-  for(int i = 0; i < station_num; i++){
-    if(graph[i].size() == 1){
-      st = i;
-      break;
-    }
-  }
-  assert(st != -1);
-  int cur = st, prev = -1;
-  bool visited_branch = false;
-  while(true){
-    if(graph[cur].size() <= 2){
-      for(const int x : graph[cur].next_list()){
-        if(x == prev) continue;
-        if(prev != -1) graph[cur].left = { prev };
-        else graph[cur].left = {};
-        graph[cur].right = { x };
-        prev = cur;
-        cur = x;
-        break;
-      }
-    }else{
-      if(visited_branch) break;
-      int a = -1, b = -1;
-      for(const int x : graph[cur].next_list()){
-        if(x == prev) continue;
-        if(a < 0) a = x;
-        else b = x;
-      }
-      if(graph[a].station.geometry[0][0] < graph[b].station.geometry[0][0]) std::swap(a, b);
-      visited_branch = true;
-      assert(prev != -1);
-      graph[cur].left = { prev };
-      graph[cur].right = { a, b };
-      prev = cur;
-      cur = a;
-    }
+// 読み込んだデータを railroad.bin の形式で書き出す
+void output_binary(const NextStationContext &ctx, const char *file_path){
+  std::vector<RailroadBinStation> bin_stations;
+  std::vector<uint32_t> railway_begin;
+  std::vector<uint64_t> path_begin = { 0 };
+  std::vector<Pos> coords;
+  std::string strings;
+  auto add_path = [&](const Path &path){
+    coords.insert(coords.end(), path.begin(), path.end());
+    path_begin.push_back(coords.size());
+  };
+  auto add_string = [&](const std::string &s) -> uint32_t {
+    const uint32_t offset = strings.size();
+    strings += s;
+    strings += '\0';
+    return offset;
+  };
+  for(const auto &sta : ctx.stations){
+    RailroadBinStation bin_sta;
+    bin_sta.station_code = sta.station_code;
+    bin_sta.railway_id = sta.railway_id;
+    bin_sta.geometry_begin = path_begin.size() - 1;
+    for(const auto &path : sta.geometry) add_path(path);
+    bin_sta.geometry_end = path_begin.size() - 1;
+    bin_sta.railway_name = add_string(sta.railway_name);
+    bin_sta.railway_company = add_string(sta.railway_company);
+    bin_sta.station_name = add_string(sta.station_name);
+    bin_sta.reserved = 0;
+    bin_stations.push_back(bin_sta);
+  }
+  for(const auto &paths : ctx.railway_paths){
+    railway_begin.push_back(path_begin.size() - 1);
+    for(const auto &path : paths) add_path(path);
+  }
+  railway_begin.push_back(path_begin.size() - 1);
+
+  RailroadBinHeader header;
+  std::memcpy(header.magic, RAILROAD_BIN_MAGIC, sizeof(header.magic));
+  header.version = RAILROAD_BIN_VERSION;
+  header.station_num = bin_stations.size();
+  header.railway_num = ctx.railway_num;
+  header.path_num = path_begin.size() - 1;
+  header.coord_num = coords.size();
+  header.station_offset = sizeof(RailroadBinHeader);
+  header.railway_offset = header.station_offset + bin_stations.size() * sizeof(RailroadBinStation);
+  header.path_offset = (header.railway_offset + railway_begin.size() * sizeof(uint32_t) + 7) / 8 * 8;
+  header.coord_offset = header.path_offset + path_begin.size() * sizeof(uint64_t);
+  header.string_offset = header.coord_offset + coords.size() * sizeof(Pos);
+  header.string_size = strings.size();
+
+  std::ofstream ofs(file_path, std::ios::binary);
+  if(!ofs){
+    std::cerr << "Error: cannot open " << file_path << "\n";
+    std::exit(1);
+  }
+  const char padding[8] = {};
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  ofs.write(reinterpret_cast<const char*>(bin_stations.data()), bin_stations.size() * sizeof(RailroadBinStation));
+  ofs.write(reinterpret_cast<const char*>(railway_begin.data()), railway_begin.size() * sizeof(uint32_t));
+  ofs.write(padding, header.path_offset - (header.railway_offset + railway_begin.size() * sizeof(uint32_t)));
+  ofs.write(reinterpret_cast<const char*>(path_begin.data()), path_begin.size() * sizeof(uint64_t));
+  ofs.write(reinterpret_cast<const char*>(coords.data()), coords.size() * sizeof(Pos));
+  ofs.write(strings.data(), strings.size());
+  if(!ofs){
+    std::cerr << "Error: cannot write " << file_path << "\n";
+    std::exit(1);
   }
-  return graph;
 }
 
-std::vector<NextStaInfo> calc_with_branches_graph(std::vector<NextStaInfo> graph){
-  const int station_num = graph.size();
-  // create dag
-  std::vector<std::vector<int>> root(station_num);
-  {
-    std::queue<std::tuple<int, int, int>> que;
-    std::vector<int> used(station_num);
-    for(const int x : graph[0].right){
-      root[0].push_back(x);
-      que.push({ x, 0, 0 });
-    }
-    for(const int x : graph[0].left){
-      que.push({ x, 0, 1 });
-    }
-    used[0] = 1;
-    while(!que.empty()){
-      int pos, prev, dir;
-      std::tie(pos, prev, dir) = que.front();
-      que.pop();
-      if(used[pos]) continue;
-      used[pos] = 1;
-      int prev_dir = 0; // 0:left,1:right
-      for(const int x : graph[pos].right){
-        if(x == prev){
-          prev_dir = 1;
-          break;
-        }
-      }
-      // prevから頂点が向けられている
-      if(!dir){
-        for(const int x : (prev_dir ? graph[pos].right : graph[pos].left)){
-          if(x == prev) continue;
-          que.push({ x, pos, 1 });
-        }
-        for(const int x : (prev_dir ? graph[pos].left : graph[pos].right)){
-          root[pos].push_back(x);
-          que.push({ x, pos, 0 });
-        }
-      }else{
-        for(const int x : (prev_dir ? graph[pos].right : graph[pos].left)){
-          root[pos].push_back(x);
-          if(x == prev) continue;
-          que.push({ x, pos, 0 });
-        }
-        for(const int x : (prev_dir ? graph[pos].left : graph[pos].right)){
-          que.push({ x, pos, 1 });
-        }
-      }
-    }
-  }
-
-  // tp-sort
-  std::vector<int> dag(station_num);
-  std::vector<int> ord;
-  std::queue<int> que;
-  for(int i = 0; i < station_num; i++){
-    for(const int x : root[i]) dag[x]++;
-  }
-  for(int i = 0; i < station_num; i++){
-    if(!dag[i]) que.push(i);
-  }
-  while(!que.empty()){
-    const int pos = que.front();
-    que.pop();
-    ord.push_back(pos);
-    for(const int x : root[pos]){
-      if(!--dag[x]) que.push(x);
-    }
-  }
-
-  // loop detected
-  if((int)ord.size() != station_num){
+// --rail-paths のときの入出力
+// 路線ごとの隣駅のグラフを読み込み,線路の順に辿った駅の番号の列を出力する(RailwayPathCalculator を参照)
+//   入力: <路線の数>, 路線ごとに <駅の数>, 駅ごとに <隣の駅の数> <隣の駅の番号...>
+//   出力: 路線ごとに <列の数>, 列ごとに <駅の数> <駅の番号...>
+void output_rail_paths(){
+  Scanner sc;
+  const int railway_num = sc.get_int();
+  for(int r = 0; r < railway_num; r++){
+    const int station_num = sc.get_int();
+    std::vector<std::vector<int>> graph(station_num);
     for(int i = 0; i < station_num; i++){
-      if((int)graph[i].left.size() == 0 && (int)graph[i].right.size() == 2){
-        std::swap(graph[i].left, graph[i].right);
-      }
-      if((int)graph[i].left.size() == 2 && (int)graph[i].right.size() == 0){
-        graph[i].right.push_back(graph[i].left.back());
-        graph[i].left.pop_back();
-      }
-    }
-
-    root.assign(station_num, {});
-    dag.assign(station_num, 0);
-    ord.clear();
-
-    // create dag
-    {
-      std::queue<std::tuple<int, int, int>> que;
-      std::vector<int> used(station_num);
-      for(const int x : graph[0].right){
-        root[0].push_back(x);
-        que.push({ x, 0, 0 });
-      }
-      for(const int x : graph[0].left){
-        que.push({ x, 0, 1 });
-      }
-      used[0] = 1;
-      while(!que.empty()){
-        int pos, prev, dir;
-        std::tie(pos, prev, dir) = que.front();
-        que.pop();
-        if(used[pos]) continue;
-        used[pos] = 1;
-        int prev_dir = 0; // 0:left,1:right
-        for(const int x : graph[pos].right){
-          if(x == prev){
-            prev_dir = 1;
-            break;
-          }
-        }
-        // prevから頂点が向けられている
-        if(!dir){
-          for(const int x : (prev_dir ? graph[pos].right : graph[pos].left)){
-            if(x == prev) continue;
-            que.push({ x, pos, 1 });
-          }
-          for(const int x : (prev_dir ? graph[pos].left : graph[pos].right)){
-            root[pos].push_back(x);
-            que.push({ x, pos, 0 });
-          }
-        }else{
-          for(const int x : (prev_dir ? graph[pos].right : graph[pos].left)){
-            root[pos].push_back(x);
-            if(x == prev) continue;
-            que.push({ x, pos, 0 });
-          }
-          for(const int x : (prev_dir ? graph[pos].left : graph[pos].right)){
-            que.push({ x, pos, 1 });
-          }
+      const int num = sc.get_int();
+      graph[i].reserve(num);
+      for(int j = 0; j < num; j++){
+        const int x = sc.get_int();
+        if(x < 0 || x >= station_num){
+          std::cerr << "Error: station index " << x << " is out of range in railway " << r << "\n";
+          std::exit(1);
         }
+        graph[i].push_back(x);
       }
     }
-
-    // tp-sort
-    for(int i = 0; i < station_num; i++){
-      for(const int x : root[i]) dag[x]++;
-    }
-    for(int i = 0; i < station_num; i++){
-      if(!dag[i]) que.push(i);
-    }
-    while(!que.empty()){
-      const int pos = que.front();
-      que.pop();
-      ord.push_back(pos);
-      for(const int x : root[pos]){
-        if(!--dag[x]) que.push(x);
-      }
+    const auto paths = RailwayPathCalculator(graph).get_graph_paths();
+    std::cout << paths.size() << "\n";
+    for(const auto &path : paths){
+      std::cout << path.size();
+      for(const int x : path) std::cout << " " << x;
+      std::cout << "\n";
     }
   }
-
-  assert((int)ord.size() == station_num);
-
-  std::vector<std::vector<int>> aligned_root(station_num);
-  std::vector<int> visited(station_num);
-
-  while(true){
-    bool all_visited = true;
-    for(int i = 0; i < station_num; i++){
-      if(!visited[i]){
-        all_visited = false;
-        break;
-      }
-    }
-    if(all_visited) break;
-    std::vector<int> dp(station_num), prev(station_num, -1);
-    for(const int i : ord){
-      for(const int x : root[i]){
-        if(visited[i] && visited[x]) continue;
-        if(dp[x] < dp[i] + 1){
-          dp[x] = dp[i] + 1;
-          prev[x] = i;
-        }
-      }
-    }
-    const int mx_idx = std::max_element(dp.begin(), dp.end()) - dp.begin();
-    assert(dp[mx_idx] >= 1);
-    int cur = mx_idx;
-    visited[cur] = 1;
-    while(prev[cur] != -1){
-      const int pre = prev[cur];
-      aligned_root[pre].push_back(cur);
-      visited[pre] = 1;
-      cur = pre;
-    }
-  }
-
-  // build
-  std::vector<std::vector<int>> aligned_root_in(station_num);
-  for(int i = 0; i < station_num; i++){
-    for(const int x : aligned_root[i]){
-      aligned_root_in[x].push_back(i);
-    }
-  }
-  if(graph[ord[0]].station.geometry[0][0].lng > graph[ord.back()].station.geometry[0][0].lng){
-    std::swap(aligned_root, aligned_root_in);
-  }
-  for(int i = 0; i < station_num; i++){
-    graph[i].left = aligned_root_in[i];
-    graph[i].right = aligned_root[i];
-  }
-  return graph;
-}
-
-// sが含まれるgraph
-RailwayType find_railway_type(const std::vector<NextStaInfo> &graph){
-  const int station_num = graph.size();
-  if(station_num == 1) return RailwayType::None;
-  std::vector<int> dirs_count(4);
-  for(const auto &data : graph){
-    const int dirs = data.size();
-    if(dirs <= 3) dirs_count[dirs]++;
-  }
-  if(dirs_count[1] == 2 && dirs_count[2] == station_num-2) return RailwayType::LinearList;
-  if(dirs_count[1] == 0 && dirs_count[2] == station_num) return RailwayType::Circle;
-  if(dirs_count[1] == 1 && dirs_count[3] == 1 && dirs_count[2] == station_num-2) return RailwayType::WithLoop;
-  return RailwayType::WithBranches;
-}
-
-std::vector<NextStaInfo> calculate_next_station(const int search_id){
-  std::vector<NextStaInfo> next_station_data;
-  std::vector<Station> railway_stations;
-  for(const auto &sta : stations){
-    if(sta.railway_id == search_id) railway_stations.push_back(sta);
-  }
-  search_next_station(railway_stations, next_station_data, railway_paths[search_id]);
-
-  std::vector<NextStaInfo> result_next_station;
-  int tot_station_num = 0;
-  for(const auto &graph : separate_to_connected_graph(next_station_data)){
-    for(int i = 0; i < (int)graph.size(); i++){
-      assert(graph[i].index == i);
-    }
-    const RailwayType type = find_railway_type(graph);
-    std::vector<NextStaInfo> directed_data;
-
-    if(type == RailwayType::None){
-      directed_data.push_back(graph[0]);
-    }else if(type == RailwayType::LinearList){
-      directed_data = calc_linear_list_graph(graph);
-    }else if(type == RailwayType::Circle){
-      directed_data = calc_circle_graph(graph);
-    }else if(type == RailwayType::WithLoop){
-      directed_data = calc_with_loop_graph(graph);
-    }else{ // RailwayType::WithBranches
-      directed_data = calc_with_branches_graph(graph);
-    }
-    for(auto &data : directed_data){
-      data.index += tot_station_num;
-      for(int &x : data.left) x += tot_station_num;
-      for(int &x : data.right) x += tot_station_num;
-    }
-    assert(directed_data.size() == graph.size());
-    for(const auto &data : directed_data){
-      result_next_station.push_back(data);
-    }
-    tot_station_num += graph.size();
-  }
-
-  assert(result_next_station.size() == next_station_data.size());
-
-  return result_next_station;
 }
 
-
-void output(const std::vector<NextStaInfo> &next_station_data){
+void output(std::ostream &os, const std::vector<NextStaInfo> &next_station_data){
   auto get_stations_json = [&](const std::vector<int> &indices, const std::string &indent){
     bool first = true;
     for(const int x : indices){
-      if(!first) std::cout << ",\n";
+      if(!first) os << ",\n";
       first = false;
-      std::cout << indent << "{";
-      std::cout << " \"stationCode\": \"" << next_station_data[x].station.station_code << "\" ";
-      std::cout << "}";
+      os << indent << "{";
+      os << " \"stationCode\": \"" << next_station_data[x].station->station_code << "\" ";
+      os << "}";
     }
-    if(!first) std::cout << "\n";
+    if(!first) os << "\n";
   };
   bool first = true;
   for(const auto &data : next_station_data){
-    if(!first) std::cout << ",\n";
+    if(!first) os << ",\n";
     first = false;
-    std::cout << "  {\n";
-    std::cout << "    \"stationCode\": \"" << data.station.station_code << "\",\n";
-    std::cout << "    \"left\": [\n";
+    os << "  {\n";
+    os << "    \"stationCode\": \"" << data.station->station_code << "\",\n";
+    os << "    \"left\": [\n";
     get_stations_json(data.left, "      ");
-    std::cout << "    ],\n";
-    std::cout << "    \"right\": [\n";
+    os << "    ],\n";
+    os << "    \"right\": [\n";
     get_stations_json(data.right, "      ");
-    std::cout << "    ]\n";
-    std::cout << "  }";
+    os << "    ]\n";
+    os << "  }";
   }
 }
 
-int main(){
+// --binary のときの出力のフォーマット(little endian)
+// 全路線の駅を出力の順に並べ,left/right は駅の番号(この並びでの位置)で表す
+//   header: NextStationBinHeader
+//   int32_t  station_code[station_num]
+//   uint32_t left_offset[station_num+1], right_offset[station_num+1] : 駅ごとのleft/rightの範囲
+//   uint32_t left[left_num], right[right_num]
+constexpr char NEXT_STATION_BIN_MAGIC[8] = { 'R', 'A', 'I', 'L', 'N', 'E', 'X', 'T' };
+constexpr uint32_t NEXT_STATION_BIN_VERSION = 1;
+
+struct NextStationBinHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t station_num;
+  uint32_t left_num;
+  uint32_t right_num;
+  uint32_t reserved[2];
+};
+static_assert(sizeof(NextStationBinHeader) == 32);
+
+void output_next_station_binary(const char *file_path, const std::vector<std::vector<NextStaInfo>> &railway_results){
+  const NextStationArrays arrays(railway_results);
+
+  NextStationBinHeader header = {};
+  std::memcpy(header.magic, NEXT_STATION_BIN_MAGIC, sizeof(header.magic));
+  header.version = NEXT_STATION_BIN_VERSION;
+  header.station_num = arrays.station_codes.size();
+  header.left_num = arrays.left.size();
+  header.right_num = arrays.right.size();
+
+  std::ofstream ofs(file_path, std::ios::binary);
+  if(!ofs){
+    std::cerr << "Error: cannot open " << file_path << "\n";
+    std::exit(1);
+  }
+  auto write = [&](const auto &values){
+    ofs.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(values[0]));
+  };
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  write(arrays.station_codes);
+  write(arrays.left_offset);
+  write(arrays.right_offset);
+  write(arrays.left);
+  write(arrays.right);
+  if(!ofs){
+    std::cerr << "Error: cannot write " << file_path << "\n";
+    std::exit(1);
+  }
+}
+
+// --stats のときに標準エラー出力に書き出すjson
+//   phasesMs        : 処理の段階ごとの経過時間(ms)
+//   railwayPhasesMs : 路線ごとの計算の段階の時間の全路線の合計(並列に計算したときは経過時間より大きくなる)
+//   counters        : 全体の数(キャッシュを使った路線は数えない)
+//   slowestRailways : 計算に時間のかかった路線とそのグラフの大きさ
+void output_stats(std::ostream &os, const NextStationContext &ctx, const PhaseTimer &timer, const int cached_railways){
+  constexpr int SLOWEST_RAILWAY_NUM = 10;
+  RailwayStats sum;
+  std::vector<double> railway_ms(ctx.railway_num);
+  for(int i = 0; i < ctx.railway_num; i++){
+    const RailwayStats &stats = ctx.railway_stats[i];
+    for(const auto &phase : RailwayStats::PHASES) sum.*phase.second += stats.*phase.second;
+    sum.path_num += stats.path_num;
+    sum.split_num += stats.split_num;
+    sum.vertex_num += stats.vertex_num;
+    sum.edge_num += stats.edge_num;
+    railway_ms[i] = stats.total_ms();
+  }
+  os << "{\n";
+  timer.write_json(os, "  ");
+  os << ",\n  \"railwayPhasesMs\": {";
+  const char *separator = " ";
+  for(const auto &phase : RailwayStats::PHASES){
+    os << separator << "\"" << phase.first << "\": " << sum.*phase.second;
+    separator = ", ";
+  }
+  os << " },\n";
+  os << "  \"counters\": { \"railways\": " << ctx.railway_num << ", \"stations\": " << ctx.stations.size()
+     << ", \"cachedRailways\": " << cached_railways << ", \"paths\": " << sum.path_num << ", \"junctionSplits\": " << sum.split_num
+     << ", \"vertices\": " << sum.vertex_num << ", \"edges\": " << sum.edge_num << ", \"bfsExpandedNodes\": " << ctx.bfs_expanded_nodes << " },\n";
+  os << "  \"slowestRailways\": [";
+  bool is_first = true;
+  for(const int id : slowest_indices(railway_ms, SLOWEST_RAILWAY_NUM)){
+    const RailwayStats &stats = ctx.railway_stats[id];
+    if(railway_ms[id] == 0) break;
+    os << (is_first ? "\n" : ",\n") << "    { \"railwayId\": " << id << ", \"railwayName\": ";
+    is_first = false;
+    write_json_string(os, ctx.stations_by_railway[id].empty() ? "" : ctx.stations_by_railway[id][0]->railway_name);
+    os << ", \"ms\": " << railway_ms[id];
+    for(const auto &phase : RailwayStats::PHASES) os << ", \"" << phase.first << "\": " << stats.*phase.second;
+    os << ", \"stations\": " << stats.station_num << ", \"paths\": " << stats.path_num << ", \"junctionSplits\": " << stats.split_num
+       << ", \"vertices\": " << stats.vertex_num << ", \"edges\": " << stats.edge_num << ", \"bfsExpandedNodes\": " << stats.bfs_expanded_nodes << " }";
+  }
+  os << (is_first ? "]\n" : "\n  ]\n");
+  os << "}\n";
+}
+
+// ./calc [options] [railroad.bin]
+//   railroad.bin を指定するとmmapして読み込み,指定しなければ標準入力から railroad.txt の形式で読み込む
+//   --convert <file> : 読み込んだデータを railroad.bin の形式で書き出して終了する
+//   --snap <deg>     : 緯度と経度の差がどちらも <deg> 以内の点を同じ頂点とする(PosIndex を参照)
+//   --threads <n>    : n個のスレッドで路線ごとに並列に計算する(出力は1スレッドのときと同じ)
+//   --stats          : 段階ごとの時間,時間のかかった路線,探索した頂点数などを標準エラー出力にjsonで出力する(output_stats を参照)
+//   --cache <file>   : 路線ごとの計算結果をこのファイルにキャッシュし,入力の変わっていない路線は再計算しない
+//   --binary <file>  : 結果をjsonの代わりにバイナリ形式でこのファイルに書き出す(NextStationBinHeader を参照)
+//   --rail-paths     : 線路のデータの代わりに隣駅のグラフを読み込み,路線の形を出力する(output_rail_paths を参照)
+int run(int argc, char *argv[]){
   std::cin.tie(nullptr);
   std::ios::sync_with_stdio(false);
-  input();
+  NextStationContext ctx;
+  const char *input_file = nullptr;
+  const char *convert_file = nullptr;
+  const char *cache_file = nullptr;
+  const char *binary_file = nullptr;
+  bool show_stats = false;
+  bool rail_paths = false;
+  for(int i = 1; i < argc; i++){
+    const std::string arg = argv[i];
+    if(arg == "--convert" && i+1 < argc){
+      convert_file = argv[++i];
+    }else if(arg == "--snap" && i+1 < argc){
+      ctx.snap_tolerance = std::atof(argv[++i]);
+    }else if(arg == "--threads" && i+1 < argc){
+      thread_num = std::max(1, std::atoi(argv[++i]));
+    }else if(arg == "--cache" && i+1 < argc){
+      cache_file = argv[++i];
+    }else if(arg == "--binary" && i+1 < argc){
+      binary_file = argv[++i];
+    }else if(arg == "--rail-paths"){
+      rail_paths = true;
+    }else if(arg == "--stats"){
+      show_stats = true;
+    }else if(arg[0] != '-' && !input_file){
+      input_file = argv[i];
+    }else{
+      std::cerr << "Error: invalid argument " << arg << "\n";
+      return 1;
+    }
+  }
+  if(rail_paths){
+    output_rail_paths();
+    return 0;
+  }
+  PhaseTimer timer(show_stats);
+  if(input_file) input_binary(ctx, input_file);
+  else input(ctx);
+  timer.lap("input");
+  if(convert_file){
+    output_binary(ctx, convert_file);
+    return 0;
+  }
+  ctx.prepare();
+  timer.lap("prepare");
+  if(show_stats) ctx.railway_stats.assign(ctx.railway_num, {});
+
+  // 路線ごとの結果をそれぞれのバッファに書き込み,最後に路線の順に出力する
+  ResultCache cache;
+  if(cache_file){
+    // 実行中の calc の実行ファイルの内容をキーに含める
+    uint64_t build_id = file_hash("/proc/self/exe");
+    if(!build_id) build_id = file_hash(argv[0]);
+    if(!cache.open(cache_file, build_id, ctx.railway_num)) cache_file = nullptr;
+    timer.lap("cacheLoad");
+  }
+  std::vector<std::string> results;
+  std::vector<std::vector<NextStaInfo>> railway_results;
+  if(binary_file) railway_results.resize(ctx.railway_num);
+  else results.resize(ctx.railway_num);
+  ctx.for_each_railway(thread_num, [&](const int id){
+    std::vector<NextStaInfo> next_station_data = cache_file ? cache.calculate(ctx, id) : ctx.calculate_next_station(id);
+    StatsLap lap(show_stats ? &ctx.railway_stats[id] : nullptr);
+    if(binary_file){
+      railway_results[id] = std::move(next_station_data);
+    }else{
+      std::ostringstream os;
+      output(os, next_station_data);
+      results[id] = os.str();
+    }
+    lap(&RailwayStats::output_ms);
+  });
+  timer.lap("calculate");
+
+  if(binary_file){
+    output_next_station_binary(binary_file, railway_results);
+  }else{
+    std::cout << "[\n";
+    for(int i = 0; i < ctx.railway_num; i++){
+      std::cout << results[i];
+      if(i != ctx.railway_num - 1) std::cout << ",";
+      std::cout << "\n";
+    }
+    std::cout << "]\n";
+  }
+  std::cout.flush();
+  timer.lap("output");
+  if(cache_file){
+    cache.save();
+    timer.lap("cacheSave");
+  }
+
+  if(show_stats) output_stats(std::cerr, ctx, timer, cache.cached_railways);
+  return 0;
+}
 
-  std::cout << "[\n";
-  for(int i = 0; i < railway_num; i++){
-    const auto next_station_data = calculate_next_station(i);
-    output(next_station_data);
-    if(i != railway_num - 1) std::cout << ",";
-    std::cout << "\n";
+// 計算を続けられない入力のときは next_station.hpp が例外を投げる
+int main(int argc, char *argv[]){
+  try{
+    return run(argc, argv);
+  }catch(const std::exception &e){
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
   }
-  std::cout << "]\n";
 }
@@ -321,30 +321,36 @@ buffer +=
 
 (async () => {
   const next_station_data = await new NextStationGen().get_next_station_data();
-  buffer += next_station_data.length + "\n";
-  buffer +=
-    next_station_data
-      .map(
-        (data) =>
-          data.stationCode +
-          " " +
-          ["left", "right"]
-            .map(
-              (dir) =>
-                data[dir].length +
-                " " +
-                data[dir].map((v) => v.stationCode).join(" ")
-            )
-            .join(" ")
-      )
-      .join("\n") + "\n";
+  const { stationCodes } = next_station_data;
+  const lines = new Array(stationCodes.length);
+  for (let i = 0; i < stationCodes.length; i++) {
+    lines[i] =
+      stationCodes[i] +
+      " " +
+      ["left", "right"]
+        .map((dir) => {
+          const offsets = next_station_data[dir + "Offsets"];
+          const indices = next_station_data[dir].subarray(
+            offsets[i],
+            offsets[i + 1]
+          );
+          return (
+            indices.length +
+            " " +
+            Array.from(indices, (x) => stationCodes[x]).join(" ")
+          );
+        })
+        .join(" ");
+  }
+  buffer += stationCodes.length + "\n";
+  buffer += lines.join("\n") + "\n";
 
   fs.writeFileSync("data/input.txt", buffer);
 
   console.log("Compile & Run");
 
   try {
-    await execShPromise("g++ datalink.cpp -o data/datalink", true);
+    await execShPromise("g++ datalink.cpp -o data/datalink -O2", true);
   } catch (err) {
     console.error(err);
     process.exit(1);
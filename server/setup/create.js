@@ -1,12 +1,23 @@
 const fs = require("fs");
+const os = require("os");
 const execShPromise = require("exec-sh").promise;
 require("dotenv").config();
 
+// node-gyp でビルドした addon (next_station_addon.cpp) があれば calc を使わずにプロセス内で計算する
+const load_next_station_addon = () => {
+  try {
+    return require("./build/Release/next_station.node");
+  } catch (err) {
+    return null;
+  }
+};
+
 class NextStationGen {
   constructor() {
     this.station_file_path = process.env.N02_STATION_FILE;
     this.railroad_file_path = process.env.N02_RAILROAD_FILE;
-    this.output_file = "data/railroad.txt";
+    this.output_file = "data/railroad.bin";
+    this.next_station_file = "data/next-station.bin";
 
     if (!fs.existsSync(this.station_file_path)) {
       console.error(`Error: ${this.station_file_path} does not exist`);
@@ -67,61 +78,116 @@ class NextStationGen {
     return [json_data, railway_id];
   };
 
-  create_data = () => {
+  // railroad.bin の内容を作成する(フォーマットは railroad_bin.hpp の RailroadBinHeader を参照)
+  create_railroad_bin = () => {
     const [station_data, railway_id] = this.calc_station_codes();
+    const railway_num = Object.keys(railway_id).length;
 
-    let buffer = "";
-
-    buffer += station_data.length + "\n";
-    buffer += Object.keys(railway_id).length + "\n";
-
-    // write station info
-    for (let i = 0; i < station_data.length; i++) {
-      const geometry = station_data[i].coordinates;
-      buffer += geometry.length + "\n";
-      buffer += geometry
-        .map(
-          (geo) =>
-            geo.length +
-            "\n" +
-            geo
-              .map((pos) => pos[1].toFixed(5) + " " + pos[0].toFixed(5))
-              .join(" ")
-        )
-        .join("\n");
-      buffer += "\n";
-      buffer +=
-        station_data[i].stationCode + " " + station_data[i].railwayId + "\n";
-      buffer +=
-        station_data[i].railwayName +
-        " " +
-        station_data[i].railwayCompany +
-        " " +
-        station_data[i].stationName +
-        "\n";
-    }
-
-    // write railway info
     let json_data = JSON.parse(fs.readFileSync(this.railroad_file_path));
     json_data = json_data.features;
 
-    buffer += json_data.length + "\n"; // pathの個数
-    for (let i = 0; i < json_data.length; i++) {
-      const s = `${json_data[i].properties.N02_003}|${json_data[i].properties.N02_004}`;
-      const geometry = json_data[i].geometry.coordinates;
-      buffer += railway_id[s] + " " + geometry.length + "\n";
-      buffer += geometry
-        .map((geo) => geo[1].toFixed(5) + " " + geo[0].toFixed(5))
-        .join(" ");
-      buffer += "\n";
-    }
-    buffer += "\n";
+    // pathを駅の線路,路線の線路の順に並べる
+    let paths = [];
+    const geometry_begin = station_data.map((elem) => {
+      const begin = paths.length;
+      elem.coordinates.forEach((geo) => paths.push(geo));
+      return begin;
+    });
+    geometry_begin.push(paths.length);
+
+    let railway_paths = new Array(railway_num).fill().map(() => []);
+    json_data.forEach((elem) => {
+      const s = `${elem.properties.N02_003}|${elem.properties.N02_004}`;
+      if (!(s in railway_id)) return; // 駅のない路線
+      railway_paths[railway_id[s]].push(elem.geometry.coordinates);
+    });
+    const railway_begin = railway_paths.map((list) => {
+      const begin = paths.length;
+      list.forEach((geo) => paths.push(geo));
+      return begin;
+    });
+    railway_begin.push(paths.length);
+
+    // 文字列は'\0'終端で並べる
+    let strings = [];
+    let string_size = 0;
+    const add_string = (s) => {
+      const buf = Buffer.from(s + "\0");
+      strings.push(buf);
+      string_size += buf.length;
+      return string_size - buf.length;
+    };
+    const names = station_data.map((elem) => [
+      add_string(elem.railwayName),
+      add_string(elem.railwayCompany),
+      add_string(elem.stationName),
+    ]);
+
+    const coord_num = paths.reduce((sum, path) => sum + path.length, 0);
+    const header_size = 80;
+    const station_size = 32;
+    const station_offset = header_size;
+    const railway_offset = station_offset + station_data.length * station_size;
+    const path_offset =
+      Math.ceil((railway_offset + (railway_num + 1) * 4) / 8) * 8;
+    const coord_offset = path_offset + (paths.length + 1) * 8;
+    const string_offset = coord_offset + coord_num * 16;
+
+    const buffer = Buffer.alloc(string_offset + string_size);
+    // header
+    buffer.write("RAILBIN\0", 0, "latin1");
+    buffer.writeUInt32LE(1, 8); // version
+    buffer.writeUInt32LE(station_data.length, 12);
+    buffer.writeUInt32LE(railway_num, 16);
+    buffer.writeUInt32LE(paths.length, 20);
+    [
+      coord_num,
+      station_offset,
+      railway_offset,
+      path_offset,
+      coord_offset,
+      string_offset,
+      string_size,
+    ].forEach((value, i) => buffer.writeBigUInt64LE(BigInt(value), 24 + i * 8));
+
+    // station info
+    station_data.forEach((elem, i) => {
+      const offset = station_offset + i * station_size;
+      buffer.writeInt32LE(elem.stationCode, offset);
+      buffer.writeInt32LE(elem.railwayId, offset + 4);
+      buffer.writeUInt32LE(geometry_begin[i], offset + 8);
+      buffer.writeUInt32LE(geometry_begin[i + 1], offset + 12);
+      names[i].forEach((name, j) =>
+        buffer.writeUInt32LE(name, offset + 16 + j * 4)
+      );
+    });
+    railway_begin.forEach((begin, i) =>
+      buffer.writeUInt32LE(begin, railway_offset + i * 4)
+    );
 
-    fs.writeFileSync(this.output_file, buffer);
+    // path info
+    let coord_count = 0;
+    paths.forEach((path, i) => {
+      buffer.writeBigUInt64LE(BigInt(coord_count), path_offset + i * 8);
+      path.forEach((pos) => {
+        const offset = coord_offset + coord_count * 16;
+        buffer.writeDoubleLE(+pos[1].toFixed(5), offset);
+        buffer.writeDoubleLE(+pos[0].toFixed(5), offset + 8);
+        coord_count++;
+      });
+    });
+    buffer.writeBigUInt64LE(BigInt(coord_count), path_offset + paths.length * 8);
+    Buffer.concat(strings).copy(buffer, string_offset);
+    return buffer;
   };
+
+  create_data = () => {
+    fs.writeFileSync(this.output_file, this.create_railroad_bin());
+  };
+
   compile_calc_cpp = async () => {
     try {
-      await execShPromise("g++ calc.cpp -o data/calc -O2", true);
+      await execShPromise("g++ calc.cpp -o data/calc -O2 -pthread", true);
     } catch (err) {
       console.error(err);
       process.exit(1);
@@ -131,15 +197,69 @@ class NextStationGen {
   run_calc_cpp = async () => {
     let result;
     try {
-      result = await execShPromise("./data/calc < data/railroad.txt", true);
+      result = await execShPromise(
+        `./data/calc --threads ${os.cpus().length} --cache data/calc-cache.bin --binary ${this.next_station_file} data/railroad.bin`,
+        true
+      );
     } catch (err) {
       console.error(err);
       process.exit(1);
     }
-    return JSON.parse(result.stdout);
+    return this.read_next_station_binary(this.next_station_file);
+  };
+
+  // calc の --binary の出力を読む(フォーマットは calc.cpp の NextStationBinHeader を参照)
+  // 各配列はファイルのバッファをそのまま参照する
+  //   stationCodes[i]: i番目の駅の駅コード
+  //   left.subarray(leftOffsets[i], leftOffsets[i + 1]): i番目の駅のleftの駅の番号(right も同様)
+  read_next_station_binary = (file_path) => {
+    const buffer = fs.readFileSync(file_path);
+    if (
+      buffer.length < 32 ||
+      buffer.toString("latin1", 0, 8) !== "RAILNEXT" ||
+      buffer.readUInt32LE(8) !== 1
+    ) {
+      console.error(`Error: ${file_path} is not a valid calc output`);
+      process.exit(1);
+    }
+    const station_num = buffer.readUInt32LE(12);
+    const left_num = buffer.readUInt32LE(16);
+    const right_num = buffer.readUInt32LE(20);
+    if (
+      buffer.length !==
+      32 + 4 * (3 * station_num + 2 + left_num + right_num)
+    ) {
+      console.error(`Error: ${file_path} has an invalid size`);
+      process.exit(1);
+    }
+    // TypedArray は要素の大きさに揃った位置からしか作れないので,揃っていなければコピーする
+    const bytes = buffer.byteOffset % 4 === 0 ? buffer : Buffer.from(buffer);
+    let offset = bytes.byteOffset + 32;
+    const take = (TypedArray, length) => {
+      const array = new TypedArray(bytes.buffer, offset, length);
+      offset += length * 4;
+      return array;
+    };
+    return {
+      stationCodes: take(Int32Array, station_num),
+      leftOffsets: take(Uint32Array, station_num + 1),
+      rightOffsets: take(Uint32Array, station_num + 1),
+      left: take(Uint32Array, left_num),
+      right: take(Uint32Array, right_num),
+    };
   };
 
   get_next_station_data = async () => {
+    const addon = load_next_station_addon();
+    if (addon) {
+      console.log("Create input data");
+      // calc とは別のファイルにキャッシュする(キーに calc と addon のどちらで計算したかが含まれるので共有しても使えない)
+      return await addon.calculate(this.create_railroad_bin(), {
+        threads: os.cpus().length,
+        cache: "data/addon-cache.bin",
+      });
+    }
+
     console.log("Create input data & Compile");
 
     await this.create_data();
@@ -150,3 +270,4 @@ class NextStationGen {
 }
 
 exports.NextStationGen = NextStationGen;
+exports.load_next_station_addon = load_next_station_addon;
@@ -7,23 +7,36 @@
 #include <tuple>
 #include <set>
 #include <map>
+#include <deque>
+#include <unordered_map>
 #include <queue>
 #include <cassert>
 #include <cstdint>
+#include <new>
+#include <climits>
+#include <array>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "scanner.hpp"
+#include "stats.hpp"
 
 constexpr double PI = 3.14159265358979323846;
 
+// --stats で出力する呼び出しの回数
+// 数える処理は数えられる計算に比べて十分に軽いので,--stats がなくても数える
+struct DatalinkCounters {
+  long long str_dist_calls = 0;
+  long long dist_km_calls = 0;
+  long long station_dist_bfs = 0; // HopDistanceIndex で分岐のある成分のラベルを作るためにBFSをした回数
+};
+DatalinkCounters counters;
+
 template<class T, class U>
 bool chmax(T &a, const U &b){ return a < b ? (a = b, 1) : 0; }
 template<class T, class U>
 bool chmin(T &a, const U &b){ return a > b ? (a = b, 1) : 0; }
 
-double get_double(){
-  int a; char c; int b;
-  std::cin >> a >> c >> b;
-  return a + b * 1e-6;
-}
-
 struct Pos {
   double lat,lng;
 
@@ -31,11 +44,19 @@ struct Pos {
   Pos(const double a, const double b) : lat(a), lng(b){}
   double dist_km(const Pos &a) const{
     static constexpr double R = PI / 180;
+    counters.dist_km_calls++;
     return acos(cos(lat*R) * cos(a.lat*R) * cos(a.lng*R - lng*R) + sin(lat*R) * sin(a.lat*R)) * 6371;
   }
   double dist(const Pos &a) const{
     return sqrt((lat-a.lat)*(lat-a.lat) + (lng-a.lng)*(lng-a.lng));
   }
+  // 地球の中心からの単位ベクトル(2点間の弦の長さは dist_km と同じ順に並ぶ)
+  void unit_vector(double &x, double &y, double &z) const{
+    static constexpr double R = PI / 180;
+    x = cos(lat*R) * cos(lng*R);
+    y = cos(lat*R) * sin(lng*R);
+    z = sin(lat*R);
+  }
   inline constexpr bool operator<(const Pos &a) const{
     if(lat != a.lat) return lat < a.lat;
     return lng < a.lng;
@@ -63,37 +84,102 @@ struct Pos {
   }
 };
 
-Pos get_coordinate(){
-  const double lat = get_double();
-  const double lng = get_double();
+Pos get_coordinate(Scanner &sc){
+  const double lat = sc.get_double();
+  const double lng = sc.get_double();
   return Pos(lat, lng);
 }
 
+// 駅名の '(' より前(almost_same な名前どうしはここが一致する)
+std::string_view base_name(std::string_view name){
+  return name.substr(0, name.find('('));
+}
+
+// 駅名,路線名,会社名に3つのデータで共通の番号をつける
+// 同じ名前は同じ番号になるので,名前の一致は番号の比較で済む
+// '(' より前の名前と「新幹線」を含むかも名前ごとに持っておく
+struct NameTable {
+  // name の番号(初めての名前なら追加する)
+  int intern(std::string_view name){
+    if(const auto it = ids.find(name); it != ids.end()) return it->second;
+    const int id = strs.size();
+    const std::string &str = strs.emplace_back(name);
+    ids.emplace(str, id);
+    base_ids.push_back(id);
+    shinkansen_flags.push_back(str.find("新幹線") != std::string::npos);
+    const std::string_view base = base_name(str);
+    if(base.size() != str.size()) base_ids[id] = intern(base);
+    return id;
+  }
+
+  const std::string &str(const int id) const{ return strs[id]; }
+  int base(const int id) const{ return base_ids[id]; }
+  bool shinkansen(const int id) const{ return shinkansen_flags[id]; }
+  int size() const{ return strs.size(); }
+
+private:
+  std::deque<std::string> strs; // 追加しても要素の参照が変わらない
+  std::unordered_map<std::string_view, int> ids;
+  std::vector<int> base_ids;
+  std::vector<bool> shinkansen_flags;
+};
+NameTable names;
 
 struct Company {
   int code;
-  std::string name;
+  int name_id;
+  const std::string &name;
 
-  Company(const int code, const std::string &name) : code(code), name(name){}
+  Company(const int code, const std::string &name) : code(code), name_id(names.intern(name)), name(names.str(name_id)){}
 };
 
+// UTF-8 の文字列を文字(コードポイント)の列にする, 不正なバイトはそのバイトの値の1文字とする
+std::u32string decode_utf8(std::string_view s){
+  std::u32string res;
+  res.reserve(s.size());
+  for(size_t i = 0; i < s.size(); ){
+    const unsigned char c = s[i];
+    const int len = c < 0x80 ? 1 : (c >> 5) == 0b110 ? 2 : (c >> 4) == 0b1110 ? 3 : (c >> 3) == 0b11110 ? 4 : 0;
+    bool valid = len != 0 && i + len <= s.size();
+    char32_t code = len == 1 ? c : c & (0x7f >> len);
+    for(int k = 1; valid && k < len; k++){
+      const unsigned char d = s[i+k];
+      if((d >> 6) != 0b10) valid = false;
+      code = code << 6 | (d & 0x3f);
+    }
+    if(!valid){
+      res.push_back(c);
+      i++;
+      continue;
+    }
+    res.push_back(code);
+    i += len;
+  }
+  return res;
+}
+
 struct Railway {
   int code;
-  std::string name;
+  int name_id;
+  const std::string &name;
+  std::u32string name_chars; // str_dist のために name を文字の列にしておく
   const Company *company;
 
-  Railway(const int code, const std::string &name, const Company *company) : code(code), name(name), company(company){}
+  Railway(const int code, const std::string &name, const Company *company) :
+    code(code), name_id(names.intern(name)), name(names.str(name_id)), name_chars(decode_utf8(name)), company(company){}
 };
 
 struct StationGroup {
   int code;
-  std::string name;
+  int name_id;
+  const std::string &name;
   int stationCnt;
 
-  StationGroup(const int code, const std::string &name) : code(code), name(name), stationCnt(0){}
+  StationGroup(const int code, const std::string &name) : code(code), name_id(names.intern(name)), name(names.str(name_id)), stationCnt(0){}
 };
 
 struct Station {
+  int index = -1; // StationDatabase::stations での位置(build() で入れる)
   int code;
   StationGroup *info;
   const Railway *rail;
@@ -105,66 +191,138 @@ struct Station {
 
   void add_left(const Station *st){ left.emplace_back(st); }
   void add_right(const Station *st){ right.emplace_back(st); }
+};
 
-  // 左の隣駅をたどって目的の駅まで移動する距離
-  int calc_left_station_dist(const Station *target){
-    if(!dist_left.empty()){
-      if(dist_left.count(target)) return dist_left[target];
-      return 100000;
-    }
-    std::queue<const Station*> que;
-    que.push(this);
-    dist_left[this] = 0;
-    while(!que.empty()){
-      const auto current = que.front();
-      que.pop();
-      for(const auto next : current->left){
-        if(dist_left.count(next)) continue;
-        dist_left[next] = dist_left[current] + 1;
-        que.push(next);
-      }
-    }
-    if(dist_left.count(target)) return dist_left[target];
-    return 100000;
+// 要素の場所が変わらない配列
+// BLOCK 個ずつのブロックに要素を作り,ブロックは動かさないので,追加しても他の要素へのポインタや参照はそのまま使える
+template<class T, int BLOCK = 1024>
+struct StableArena {
+  StableArena() = default;
+  StableArena(const StableArena&) = delete;
+  StableArena &operator=(const StableArena&) = delete;
+  ~StableArena(){ clear(); }
+
+  template<class... Args>
+  T &emplace_back(Args&&... args){
+    if(count % BLOCK == 0) blocks.emplace_back(static_cast<T*>(::operator new(sizeof(T) * BLOCK, std::align_val_t(alignof(T)))));
+    T *p = new(blocks.back() + count % BLOCK) T(std::forward<Args>(args)...);
+    count++;
+    return *p;
+  }
+  void clear(){
+    for(size_t i = 0; i < count; i++) (*this)[i].~T();
+    for(const auto block : blocks) ::operator delete(block, std::align_val_t(alignof(T)));
+    blocks.clear();
+    count = 0;
   }
 
-  int calc_right_station_dist(const Station *target){
-    if(!dist_right.empty()){
-      if(dist_right.count(target)) return dist_right[target];
-      return 100000;
-    }
-    std::queue<const Station*> que;
-    que.push(this);
-    dist_right[this] = 0;
-    while(!que.empty()){
-      const auto current = que.front();
-      que.pop();
-      for(const auto next : current->right){
-        if(dist_right.count(next)) continue;
-        dist_right[next] = dist_right[current] + 1;
-        que.push(next);
-      }
+  size_t size() const{ return count; }
+  bool empty() const{ return count == 0; }
+  T &operator[](const size_t i){ return blocks[i / BLOCK][i % BLOCK]; }
+  const T &operator[](const size_t i) const{ return blocks[i / BLOCK][i % BLOCK]; }
+  T &front(){ return (*this)[0]; }
+  const T &front() const{ return (*this)[0]; }
+  T &back(){ return (*this)[count - 1]; }
+  const T &back() const{ return (*this)[count - 1]; }
+
+  template<class Arena, class U>
+  struct Iterator {
+    Arena *arena;
+    size_t i;
+    U &operator*() const{ return (*arena)[i]; }
+    U *operator->() const{ return &(*arena)[i]; }
+    Iterator &operator++(){ i++; return *this; }
+    bool operator!=(const Iterator &it) const{ return i != it.i; }
+    bool operator==(const Iterator &it) const{ return i == it.i; }
+  };
+  using iterator = Iterator<StableArena, T>;
+  using const_iterator = Iterator<const StableArena, const T>;
+  iterator begin(){ return { this, 0 }; }
+  iterator end(){ return { this, count }; }
+  const_iterator begin() const{ return { this, 0 }; }
+  const_iterator end() const{ return { this, count }; }
+
+private:
+  std::vector<T*> blocks;
+  size_t count = 0;
+};
+
+// 整数のキーの開番地法(線形探索)のハッシュ表,要素を消すことはないので墓標はいらない
+// 追加で表を広げると値の場所が変わるので,参照は追加が終わってから取る
+template<class V>
+struct IntHashMap {
+  V &operator[](const int key){
+    if((count + 1) * 2 > (int)slots.size()) rehash(std::max<size_t>(16, slots.size() * 2));
+    const size_t i = probe(key);
+    if(!slots[i].used){
+      slots[i].used = true;
+      slots[i].key = key;
+      count++;
     }
-    if(dist_right.count(target)) return dist_right[target];
-    return 100000;
+    return slots[i].value;
+  }
+  V *find(const int key){
+    if(slots.empty()) return nullptr;
+    const size_t i = probe(key);
+    return slots[i].used ? &slots[i].value : nullptr;
+  }
+  void clear(){
+    slots.clear();
+    count = 0;
   }
 
 private:
-  std::map<const Station*, int> dist_left, dist_right;
+  struct Slot {
+    bool used = false;
+    int key;
+    V value;
+  };
+  std::vector<Slot> slots; // 大きさは 2^(32-shift)
+  int count = 0;
+  int shift = 32;
+
+  size_t probe(const int key) const{
+    const size_t mask = slots.size() - 1;
+    size_t i = ((uint32_t)key * 0x9E3779B1u) >> shift;
+    while(slots[i].used && slots[i].key != key) i = (i + 1) & mask;
+    return i;
+  }
+  void rehash(const size_t size){
+    std::vector<Slot> old(size);
+    old.swap(slots);
+    shift = 32;
+    for(size_t s = size; s > 1; s /= 2) shift--;
+    for(auto &slot : old){
+      if(!slot.used) continue;
+      Slot &s = slots[probe(slot.key)];
+      s.used = true;
+      s.key = slot.key;
+      s.value = std::move(slot.value);
+    }
+  }
 };
 
 struct StationDatabase {
-  std::vector<Station> stations;
-  std::vector<StationGroup> stationGroups;
-  std::vector<Railway> railways;
-  std::vector<Company> companies;
+  // 駅や路線はポインタで互いに指すので,場所の変わらない配列に入れる
+  StableArena<Station> stations;
+  StableArena<StationGroup> stationGroups;
+  StableArena<Railway> railways;
+  StableArena<Company> companies;
+  // 駅の位置の単位ベクトルを stations の順に並べたもの(build() で作る)
+  std::vector<double> unit_x, unit_y, unit_z;
 
   void build(){
     stations_data.clear();
     railway_stations_mut.clear();
     railway_stations.clear();
+    unit_x.resize(stations.size());
+    unit_y.resize(stations.size());
+    unit_z.resize(stations.size());
 
-    for(auto &station : stations){
+    for(int i = 0; i < (int)stations.size(); i++){
+      auto &station = stations[i];
+      station.index = i;
+      station.pos.unit_vector(unit_x[i], unit_y[i], unit_z[i]);
       stations_data[station.code] = &station;
       railway_stations_mut[station.rail->code].emplace_back(&station);
     }
@@ -174,41 +332,358 @@ struct StationDatabase {
   }
 
   Station *get_station(const int stationCode){
-    assert(stations_data.count(stationCode));
-    return stations_data[stationCode];
+    Station **res = stations_data.find(stationCode);
+    assert(res);
+    return *res;
   }
   std::vector<const Station*> &get_railway_stations(const int railwayCode){
-    assert(railway_stations.count(railwayCode));
-    return railway_stations[railwayCode];
+    auto res = railway_stations.find(railwayCode);
+    assert(res);
+    return *res;
   }
   std::vector<Station*> &get_railway_stations_mut(const int railwayCode){
-    assert(railway_stations_mut.count(railwayCode));
-    return railway_stations_mut[railwayCode];
+    auto res = railway_stations_mut.find(railwayCode);
+    assert(res);
+    return *res;
   }
 
 private:
-  std::map<int, Station*> stations_data;
-  std::map<int, std::vector<const Station*>> railway_stations;
-  std::map<int, std::vector<Station*>> railway_stations_mut;
+  IntHashMap<Station*> stations_data;
+  IntHashMap<std::vector<const Station*>> railway_stations;
+  IntHashMap<std::vector<Station*>> railway_stations_mut;
 };
 
 StationDatabase eki_data;
 StationDatabase ekispert_data;
 StationDatabase kokudo_route_data;
 
-int str_dist(const std::string &s, const std::string &t){
-  std::vector<std::vector<int>> dp((int)s.size()+1, std::vector<int>((int)t.size()+1));
-  for(int i = 0; i <= s.size(); i++) dp[i][0] = i;
-  for(int i = 0; i <= t.size(); i++) dp[0][i] = i;
-  for(int i = 1; i <= s.size(); i++){
-    for(int j = 1; j <= t.size(); j++){
-      dp[i][j] = std::min(std::min(dp[i-1][j], dp[i][j-1]) + 1, dp[i-1][j-1] + (s[i-1] == t[j-1] ? 0 : 1));
+// 左(または右)の隣駅をたどって移動する駅の数(たどり着かなければ UNREACHABLE)
+// 隣駅が変わらないデータで作り,駅は Station::index で引く
+// 隣駅が1つ以下の駅だけの連結成分ではたどる道が1つに決まるので,隣駅を親とする木の深さと行きがけ順の区間,閉路の上の位置から O(1) で求める
+// 分岐のある連結成分は,最初に聞かれたときに成分ごとに 2-hop ラベル(pruned landmark labeling)を作り,共通のハブを通る距離の最小値で求める
+// 線路のように木に近い成分ではラベルは短いが,最悪の場合はラベルの大きさの合計も成分の駅の数の2乗になる
+struct HopDistanceIndex {
+  static constexpr int UNREACHABLE = 100000;
+
+  HopDistanceIndex(const StationDatabase &data, std::vector<const Station*> Station::*side) : stations(data.stations), side(side){
+    const int n = stations.size();
+    // 分岐のある駅を含む弱連結成分を求める
+    std::vector<int> parent(n);
+    for(int i = 0; i < n; i++) parent[i] = i;
+    auto find = [&](int x){
+      while(parent[x] != x) x = parent[x] = parent[parent[x]];
+      return x;
+    };
+    next.assign(n, -1);
+    std::vector<bool> branch(n, false);
+    for(int i = 0; i < n; i++){
+      for(const auto st : stations[i].*side){
+        if(st->index == i) continue;
+        parent[find(i)] = find(st->index);
+        if(next[i] >= 0 && next[i] != st->index) branch[i] = true;
+        next[i] = st->index;
+      }
+    }
+    std::vector<bool> branch_root(n, false);
+    for(int i = 0; i < n; i++){
+      if(branch[i]) branch_root[find(i)] = true;
+    }
+    // 分岐のある成分に番号をつけ,成分ごとに駅を分ける
+    component.assign(n, -1);
+    local.assign(n, -1);
+    std::vector<int> component_id(n, -1);
+    for(int i = 0; i < n; i++){
+      if(!branch_root[find(i)]) continue;
+      int &id = component_id[find(i)];
+      if(id < 0){
+        id = component_stations.size();
+        component_stations.emplace_back();
+      }
+      component[i] = id;
+      local[i] = component_stations[id].size();
+      component_stations[id].push_back(i);
+    }
+    labeled.assign(component_stations.size(), false);
+    label_in.resize(n);
+    label_out.resize(n);
+
+    // 分岐のない成分: 隣駅をたどって最後に着く駅か閉路の駅を根とする
+    depth.assign(n, 0);
+    root.assign(n, -1);
+    cycle_id.assign(n, -1);
+    cycle_pos.assign(n, -1);
+    cycle_len.assign(n, 0);
+    int cycle_num = 0;
+    std::vector<int> state(n, 0); // 0: 未訪問, 1: たどっている途中, 2: 済み
+    std::vector<int> path;
+    for(int i = 0; i < n; i++){
+      if(component[i] >= 0 || state[i]) continue;
+      path.clear();
+      int u = i;
+      while(u >= 0 && state[u] == 0){
+        state[u] = 1;
+        path.push_back(u);
+        u = next[u];
+      }
+      if(u >= 0 && state[u] == 1){
+        // path の u から後ろが閉路
+        const int begin = std::find(path.begin(), path.end(), u) - path.begin();
+        for(int k = begin; k < (int)path.size(); k++){
+          const int v = path[k];
+          cycle_id[v] = cycle_num;
+          cycle_pos[v] = k - begin;
+          cycle_len[v] = path.size() - begin;
+          root[v] = v;
+          state[v] = 2;
+        }
+        cycle_num++;
+        path.resize(begin);
+      }
+      for(int k = (int)path.size() - 1; k >= 0; k--){
+        const int v = path[k];
+        if(next[v] < 0){
+          root[v] = v;
+        }else{
+          root[v] = root[next[v]];
+          depth[v] = depth[next[v]] + 1;
+        }
+        state[v] = 2;
+      }
+    }
+    // 隣駅を親とする木(閉路の辺は除く)の行きがけ順の区間
+    std::vector<std::vector<int>> children(n);
+    for(int i = 0; i < n; i++){
+      if(component[i] >= 0 || root[i] == i) continue;
+      children[next[i]].push_back(i);
+    }
+    tin.assign(n, 0);
+    tout.assign(n, 0);
+    int order = 0;
+    std::vector<std::pair<int, int>> stack;
+    for(int r = 0; r < n; r++){
+      if(component[r] >= 0 || root[r] != r) continue;
+      tin[r] = order++;
+      stack.emplace_back(r, 0);
+      while(!stack.empty()){
+        auto &[v, k] = stack.back();
+        if(k < (int)children[v].size()){
+          const int c = children[v][k++];
+          tin[c] = order++;
+          stack.emplace_back(c, 0);
+        }else{
+          tout[v] = order;
+          stack.pop_back();
+        }
+      }
+    }
+  }
+
+  int dist(const Station *from, const Station *to){
+    const int u = from->index, v = to->index;
+    if(component[u] >= 0 || component[v] >= 0){
+      if(component[u] != component[v]) return UNREACHABLE;
+      if(!labeled[component[u]]) build_labels(component[u]);
+      return query(label_out[u], label_in[v]);
+    }
+    if(cycle_id[v] >= 0){
+      // 閉路の上の駅へは u の根まで行ってから閉路を回る
+      const int r = root[u];
+      if(cycle_id[r] != cycle_id[v]) return UNREACHABLE;
+      return depth[u] + (cycle_pos[v] - cycle_pos[r] + cycle_len[v]) % cycle_len[v];
+    }
+    if(tin[v] <= tin[u] && tin[u] < tout[v]) return depth[u] - depth[v];
+    return UNREACHABLE;
+  }
+
+private:
+  const StableArena<Station> &stations;
+  std::vector<const Station*> Station::*side;
+  std::vector<int> next; // 分岐のない成分での隣駅(なければ -1)
+  std::vector<int> depth, root, cycle_id, cycle_pos, cycle_len, tin, tout;
+  // 分岐のある成分の番号(でなければ -1),成分の中での番号,成分ごとの駅,ラベルを作ったかどうか
+  std::vector<int> component, local;
+  std::vector<std::vector<int>> component_stations;
+  std::vector<bool> labeled;
+  // (ハブの順位, 距離) をハブの順位の昇順に並べたもの
+  // label_out[u] は u からハブへの距離,label_in[v] はハブから v への距離
+  std::vector<std::vector<std::pair<int, int>>> label_in, label_out;
+  int hub_num = 0;
+
+  static int query(const std::vector<std::pair<int, int>> &out, const std::vector<std::pair<int, int>> &in){
+    int res = UNREACHABLE;
+    for(size_t i = 0, j = 0; i < out.size() && j < in.size();){
+      if(out[i].first < in[j].first) i++;
+      else if(out[i].first > in[j].first) j++;
+      else res = std::min(res, out[i++].second + in[j++].second);
+    }
+    return res;
+  }
+
+  // 隣駅の多い駅から順にハブとし,前向きと後ろ向きのBFSでラベルを足す
+  // ほかのハブを通って同じ距離以下で行ける駅から先はたどらない
+  void build_labels(const int c){
+    labeled[c] = true;
+    const auto &members = component_stations[c];
+    const int m = members.size();
+    std::vector<std::vector<int>> in_adj(m);
+    std::vector<int> degree(m, 0);
+    for(int k = 0; k < m; k++){
+      for(const auto st : stations[members[k]].*side){
+        if(st->index == members[k]) continue;
+        in_adj[local[st->index]].push_back(members[k]);
+        degree[k]++;
+        degree[local[st->index]]++;
+      }
+    }
+    std::vector<int> order(m);
+    for(int k = 0; k < m; k++) order[k] = k;
+    std::stable_sort(order.begin(), order.end(), [&](const int a, const int b){ return degree[a] > degree[b]; });
+
+    std::vector<int> hops(m, -1), visited;
+    std::vector<int> que;
+    for(const int k : order){
+      const int h = members[k];
+      const int rank = hub_num++;
+      for(const bool forward : { true, false }){
+        counters.station_dist_bfs++;
+        que.assign(1, h);
+        hops[k] = 0;
+        visited.assign(1, k);
+        for(size_t head = 0; head < que.size(); head++){
+          const int v = que[head];
+          const int d = hops[local[v]];
+          if(forward){
+            if(query(label_out[h], label_in[v]) <= d) continue;
+            label_in[v].emplace_back(rank, d);
+          }else{
+            if(query(label_out[v], label_in[h]) <= d) continue;
+            label_out[v].emplace_back(rank, d);
+          }
+          auto push = [&](const int x){
+            const int lx = local[x];
+            if(hops[lx] >= 0) return;
+            hops[lx] = d + 1;
+            visited.push_back(lx);
+            que.push_back(x);
+          };
+          if(forward){
+            for(const auto st : stations[v].*side) push(st->index);
+          }else{
+            for(const int x : in_adj[local[v]]) push(x);
+          }
+        }
+        for(const int lx : visited) hops[lx] = -1;
+      }
     }
   }
-  return dp[s.size()][t.size()];
+};
+
+// 1点 (qx, qy, qz) から n 個の単位ベクトルまでの弦の長さの2乗を out に入れる
+void chord2_batch_scalar(const double *x, const double *y, const double *z, const int n, const double qx, const double qy, const double qz, double *out){
+  for(int i = 0; i < n; i++){
+    const double dx = x[i] - qx, dy = y[i] - qy, dz = z[i] - qz;
+    out[i] = dx * dx + dy * dy + dz * dz;
+  }
 }
 
-std::string base64decode(const std::string &s){
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+void chord2_batch_avx2(const double *x, const double *y, const double *z, const int n, const double qx, const double qy, const double qz, double *out){
+  const __m256d vx = _mm256_set1_pd(qx), vy = _mm256_set1_pd(qy), vz = _mm256_set1_pd(qz);
+  int i = 0;
+  for(; i + 4 <= n; i += 4){
+    const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), vx);
+    const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i), vy);
+    const __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z + i), vz);
+    const __m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+    _mm256_storeu_pd(out + i, d2);
+  }
+  chord2_batch_scalar(x + i, y + i, z + i, n - i, qx, qy, qz, out + i);
+}
+#endif
+
+// AVX2 が使えれば4点ずつ計算する
+void chord2_batch(const double *x, const double *y, const double *z, const int n, const double qx, const double qy, const double qz, double *out){
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if(has_avx2){
+    chord2_batch_avx2(x, y, z, n, qx, qy, qz, out);
+    return;
+  }
+#endif
+  chord2_batch_scalar(x, y, z, n, qx, qy, qz, out);
+}
+
+// 文字単位の編集距離
+// 短い方が64文字以下なら Myers/Hyyrö のビット並列のアルゴリズムで,列ごとに DP の1列分の差分をビット列で更新する
+int str_dist(const std::u32string &s, const std::u32string &t){
+  counters.str_dist_calls++;
+  const std::u32string &pattern = s.size() <= t.size() ? s : t;
+  const std::u32string &text = s.size() <= t.size() ? t : s;
+  const int m = pattern.size();
+  if(m == 0) return text.size();
+  if(m > 64){
+    // 長い文字列はめったにないので1行分の DP で計算する
+    static thread_local std::vector<int> dp;
+    dp.resize(m + 1);
+    for(int i = 0; i <= m; i++) dp[i] = i;
+    for(const char32_t c : text){
+      int diag = dp[0]++;
+      for(int i = 1; i <= m; i++){
+        const int up = dp[i];
+        dp[i] = std::min(std::min(up, dp[i-1]) + 1, diag + (pattern[i-1] == c ? 0 : 1));
+        diag = up;
+      }
+    }
+    return dp[m];
+  }
+
+  // pattern の文字ごとに現れる位置のビット列(開番地法のハッシュ表)
+  constexpr int TABLE_SIZE = 128;
+  char32_t keys[TABLE_SIZE];
+  uint64_t masks[TABLE_SIZE];
+  bool used[TABLE_SIZE] = {};
+  auto slot_of = [&](const char32_t c){
+    int slot = (c * 0x9E3779B1u) >> 25;
+    while(used[slot] && keys[slot] != c) slot = (slot + 1) & (TABLE_SIZE - 1);
+    return slot;
+  };
+  for(int i = 0; i < m; i++){
+    const int slot = slot_of(pattern[i]);
+    if(!used[slot]){
+      used[slot] = true;
+      keys[slot] = pattern[i];
+      masks[slot] = 0;
+    }
+    masks[slot] |= uint64_t(1) << i;
+  }
+
+  const uint64_t last = uint64_t(1) << (m - 1);
+  uint64_t pv = ~uint64_t(0), mv = 0;
+  int score = m;
+  for(const char32_t c : text){
+    const int slot = slot_of(c);
+    const uint64_t eq = used[slot] ? masks[slot] : 0;
+    const uint64_t xv = eq | mv;
+    const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint64_t ph = mv | ~(xh | pv);
+    uint64_t mh = pv & xh;
+    if(ph & last) score++;
+    else if(mh & last) score--;
+    // 1行目は列ごとに1ずつ増える
+    ph = ph << 1 | 1;
+    mh <<= 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+  }
+  return score;
+}
+
+int str_dist(const std::string &s, const std::string &t){
+  return str_dist(decode_utf8(s), decode_utf8(t));
+}
+
+std::string base64decode(std::string_view s){
   std::string res;
   uint8_t phase = 0;
   char b;
@@ -261,26 +736,21 @@ std::string base64decode(const std::string &s){
   return res;
 }
 
-void get_station_data(StationDatabase &data){
-  int station_num;
-  std::cin >> station_num;
+void get_station_data(Scanner &sc, StationDatabase &data){
+  const int station_num = sc.get_int();
   std::map<int, const Company*> company_cnt;
   std::map<std::pair<int, int>, const Railway*> railway_cnt;
   std::map<int, StationGroup*> group_cnt;
   std::map<int, Station*> station_cnt;
-  data.railways.reserve(station_num + 100);
-  data.companies.reserve(station_num);
-  data.stationGroups.reserve(station_num + 200);
-  data.stations.reserve(station_num + 200);
   for(int i = 0; i < station_num; i++){
-    int stationCode, stationGroupCode; std::string stationName;
-    int railwayCode; std::string railwayName;
-    int companyCode; std::string companyName;
-    std::cin >> stationCode >> stationGroupCode >> stationName >> railwayCode >> railwayName >> companyCode >> companyName;
-    stationName = base64decode(stationName);
-    railwayName = base64decode(railwayName);
-    companyName = base64decode(companyName);
-    const Pos pos = get_coordinate();
+    const int stationCode = sc.get_int();
+    const int stationGroupCode = sc.get_int();
+    const std::string stationName = base64decode(sc.get_token());
+    const int railwayCode = sc.get_int();
+    const std::string railwayName = base64decode(sc.get_token());
+    const int companyCode = sc.get_int();
+    const std::string companyName = base64decode(sc.get_token());
+    const Pos pos = get_coordinate(sc);
     if(!company_cnt.count(companyCode)){
       data.companies.emplace_back(companyCode, companyName);
       company_cnt[companyCode] = &data.companies.back();
@@ -298,51 +768,267 @@ void get_station_data(StationDatabase &data){
     station_cnt[stationCode] = &data.stations.back();
   }
 
-  int info_num;
-  std::cin >> info_num;
+  const int info_num = sc.get_int();
   for(int i = 0; i < info_num; i++){
-    int stationCode, left_num;
-    std::cin >> stationCode >> left_num;
+    const int stationCode = sc.get_int();
+    const int left_num = sc.get_int();
     for(int j = 0; j < left_num; j++){
-      int code;
-      std::cin >> code;
+      const int code = sc.get_int();
       station_cnt[stationCode]->add_left(station_cnt[code]);
     }
-    int right_num;
-    std::cin >> right_num;
+    const int right_num = sc.get_int();
     for(int j = 0; j < right_num; j++){
-      int code;
-      std::cin >> code;
+      const int code = sc.get_int();
       station_cnt[stationCode]->add_right(station_cnt[code]);
     }
   }
 };
 void input(){
-  get_station_data(ekispert_data);
-  get_station_data(eki_data);
-  get_station_data(kokudo_route_data);
+  Scanner sc;
+  get_station_data(sc, ekispert_data);
+  get_station_data(sc, eki_data);
+  get_station_data(sc, kokudo_route_data);
 }
 
+// 駅の座標を一様なグリッドに入れて,ある点から dist_km が一定以下になりうる駅を探す
+// 駅は与えた列での番号で返す
+struct StationGrid {
+  explicit StationGrid(const std::vector<const Station*> &stations) : stations(stations){
+    if(stations.empty()) return;
+    min_lat = max_lat = stations[0]->pos.lat;
+    min_lng = max_lng = stations[0]->pos.lng;
+    for(const auto station : stations){
+      chmin(min_lat, station->pos.lat);
+      chmax(max_lat, station->pos.lat);
+      chmin(min_lng, station->pos.lng);
+      chmax(max_lng, station->pos.lng);
+    }
+    // 座標が外れた駅があってもセルの数が増えすぎないようにする
+    cell = 0.02;
+    while((max_lat - min_lat) / cell * (max_lng - min_lng) / cell > (1 << 22)) cell *= 2;
+    rows = (int)((max_lat - min_lat) / cell) + 1;
+    cols = (int)((max_lng - min_lng) / cell) + 1;
+    first.assign((size_t)rows * cols + 1, 0);
+    for(const auto station : stations) first[cell_of(station->pos) + 1]++;
+    for(size_t i = 0; i + 1 < first.size(); i++) first[i+1] += first[i];
+    items.resize(stations.size());
+    std::vector<int> fill(first.begin(), first.end() - 1);
+    for(int i = 0; i < (int)stations.size(); i++) items[fill[cell_of(stations[i]->pos)]++] = i;
+  }
+
+  // pos に近いセルから環状に広げて調べ,駅が見つかった最初の環の駅を res に入れる
+  void nearest_ring(const Pos &pos, std::vector<int> &res) const{
+    res.clear();
+    if(stations.empty()) return;
+    const int r0 = row_of(pos.lat), c0 = col_of(pos.lng);
+    const int max_ring = std::max({ r0, rows - 1 - r0, c0, cols - 1 - c0 });
+    for(int ring = 0; ring <= max_ring && res.empty(); ring++){
+      for(int r = r0 - ring; r <= r0 + ring; r++){
+        if(r < 0 || r >= rows) continue;
+        const int step = (r == r0 - ring || r == r0 + ring) ? 1 : 2 * ring;
+        for(int c = c0 - ring; c <= c0 + ring; c += std::max(step, 1)){
+          if(c < 0 || c >= cols) continue;
+          append_cell(r, c, res);
+        }
+      }
+    }
+  }
+
+  // pos から dist_km が radius_km 以下になりうる駅を番号の昇順で res に入れる(余分な駅を含んでよい)
+  void query(const Pos &pos, const double radius_km, std::vector<int> &res) const{
+    res.clear();
+    if(stations.empty()) return;
+    // 計算誤差の分だけ広げた半径の球冠を囲む緯度経度の範囲
+    static constexpr double R = PI / 180;
+    const double angle = (radius_km + 0.01) / 6371;
+    const double dlat = angle / R;
+    const double s = std::sin(angle) / std::cos(pos.lat * R);
+    const double dlng = s >= 1 || angle >= PI / 2 ? 360 : std::asin(s) / R * 1.001;
+    const int r_begin = row_of(pos.lat - dlat), r_end = row_of(pos.lat + dlat);
+    const int c_begin = col_of(pos.lng - dlng), c_end = col_of(pos.lng + dlng);
+    for(int r = r_begin; r <= r_end; r++){
+      for(int c = c_begin; c <= c_end; c++) append_cell(r, c, res);
+    }
+    std::sort(res.begin(), res.end());
+  }
+
+private:
+  const std::vector<const Station*> &stations;
+  double min_lat = 0, max_lat = 0, min_lng = 0, max_lng = 0, cell = 1;
+  int rows = 0, cols = 0;
+  std::vector<int> first, items;
+
+  int row_of(const double lat) const{
+    return std::clamp((int)std::floor((lat - min_lat) / cell), 0, rows - 1);
+  }
+  int col_of(const double lng) const{
+    return std::clamp((int)std::floor((lng - min_lng) / cell), 0, cols - 1);
+  }
+  size_t cell_of(const Pos &pos) const{
+    return (size_t)row_of(pos.lat) * cols + col_of(pos.lng);
+  }
+  void append_cell(const int r, const int c, std::vector<int> &res) const{
+    const size_t idx = (size_t)r * cols + c;
+    res.insert(res.end(), items.begin() + first[idx], items.begin() + first[idx+1]);
+  }
+};
+
+// 単位ベクトルの k-d 木で,使った駅を除きながら番号が begin 以上の駅を探す(calc_nearest_dist の貪欲な割り当て用)
+// 部分木ごとに点を囲む箱と使っていない駅の番号の最大値を持ち,どちらかで外れる部分木は調べない
+struct UnusedStationTree {
+  UnusedStationTree(const double *xs, const double *ys, const double *zs, const int n) : n(n), perm(n), where(n), alive(n, true), nodes(n){
+    for(int j = 0; j < n; j++){
+      perm[j] = j;
+      pts.push_back({ xs[j], ys[j], zs[j] });
+    }
+    build(0, n);
+    for(int p = 0; p < n; p++) where[perm[p]] = p;
+  }
+
+  bool used(const int j) const{ return !alive[j]; }
+
+  void remove(const int j){
+    if(!alive[j]) return;
+    alive[j] = false;
+    update(0, n, where[j]);
+  }
+
+  // 弦の長さの2乗が min_chord2 より大きい駅での最小値(なければ 1e9)
+  double nearest(const double qx, const double qy, const double qz, const int begin, const double min_chord2) const{
+    const double q[3] = { qx, qy, qz };
+    double best = 1e9;
+    nearest(0, n, q, begin, min_chord2, best);
+    return best;
+  }
+
+  // 弦の長さの2乗が limit 以下の駅を番号の昇順で res に入れる
+  void query(const double qx, const double qy, const double qz, const int begin, const double limit, std::vector<int> &res) const{
+    const double q[3] = { qx, qy, qz };
+    res.clear();
+    query(0, n, q, begin, limit, res);
+    std::sort(res.begin(), res.end());
+  }
+
+private:
+  struct Node {
+    double lo[3], hi[3];
+    int max_alive; // 使っていない駅の番号の最大値(なければ -1)
+  };
+  int n;
+  std::vector<std::array<double, 3>> pts; // 駅の番号の順
+  std::vector<int> perm, where; // 木の位置 -> 駅の番号,その逆
+  std::vector<bool> alive;
+  std::vector<Node> nodes; // 範囲 [l, r) の部分木の根は (l+r)/2 に置く
+
+  void build(const int l, const int r){
+    if(l >= r) return;
+    const int mid = (l + r) / 2;
+    Node &node = nodes[mid];
+    for(int k = 0; k < 3; k++){
+      node.lo[k] = 1e9;
+      node.hi[k] = -1e9;
+    }
+    node.max_alive = -1;
+    for(int p = l; p < r; p++){
+      for(int k = 0; k < 3; k++){
+        chmin(node.lo[k], pts[perm[p]][k]);
+        chmax(node.hi[k], pts[perm[p]][k]);
+      }
+      chmax(node.max_alive, perm[p]);
+    }
+    int axis = 0;
+    for(int k = 1; k < 3; k++){
+      if(node.hi[k] - node.lo[k] > node.hi[axis] - node.lo[axis]) axis = k;
+    }
+    std::nth_element(perm.begin() + l, perm.begin() + mid, perm.begin() + r, [&](const int a, const int b){
+      if(pts[a][axis] != pts[b][axis]) return pts[a][axis] < pts[b][axis];
+      return a < b;
+    });
+    build(l, mid);
+    build(mid + 1, r);
+  }
+
+  int max_alive(const int l, const int r) const{
+    return l < r ? nodes[(l + r) / 2].max_alive : -1;
+  }
+
+  void update(const int l, const int r, const int p){
+    const int mid = (l + r) / 2;
+    if(p < mid) update(l, mid, p);
+    if(p > mid) update(mid + 1, r, p);
+    nodes[mid].max_alive = std::max({ alive[perm[mid]] ? perm[mid] : -1, max_alive(l, mid), max_alive(mid + 1, r) });
+  }
+
+  // 箱の中の点までの弦の長さの2乗の下限
+  double box_dist2(const int l, const int r, const double q[3]) const{
+    const Node &node = nodes[(l + r) / 2];
+    double d2 = 0;
+    for(int k = 0; k < 3; k++){
+      const double d = std::max({ 0.0, node.lo[k] - q[k], q[k] - node.hi[k] });
+      d2 += d * d;
+    }
+    return d2;
+  }
+
+  double chord2(const int j, const double q[3]) const{
+    const double dx = pts[j][0] - q[0], dy = pts[j][1] - q[1], dz = pts[j][2] - q[2];
+    return dx * dx + dy * dy + dz * dz;
+  }
+
+  void nearest(const int l, const int r, const double q[3], const int begin, const double min_chord2, double &best) const{
+    if(max_alive(l, r) < begin || box_dist2(l, r, q) >= best) return;
+    const int mid = (l + r) / 2;
+    const int j = perm[mid];
+    if(alive[j] && j >= begin){
+      const double d2 = chord2(j, q);
+      if(d2 > min_chord2 && d2 < best) best = d2;
+    }
+    // 近い方の子から調べる
+    if(mid - l > 0 && r - mid - 1 > 0 && box_dist2(mid + 1, r, q) < box_dist2(l, mid, q)){
+      nearest(mid + 1, r, q, begin, min_chord2, best);
+      nearest(l, mid, q, begin, min_chord2, best);
+    }else{
+      nearest(l, mid, q, begin, min_chord2, best);
+      nearest(mid + 1, r, q, begin, min_chord2, best);
+    }
+  }
+
+  void query(const int l, const int r, const double q[3], const int begin, const double limit, std::vector<int> &res) const{
+    if(max_alive(l, r) < begin || box_dist2(l, r, q) > limit) return;
+    const int mid = (l + r) / 2;
+    const int j = perm[mid];
+    if(alive[j] && j >= begin && chord2(j, q) <= limit) res.push_back(j);
+    query(l, mid, q, begin, limit, res);
+    query(mid + 1, r, q, begin, limit, res);
+  }
+};
+
+// 同じ名前か,片方の '(' より前がもう片方と同じ
 bool almost_same(const std::string &s, const std::string &t){
-  if(s == t) return true;
-  if(s.find('(') != std::string::npos && s.substr(0, s.find('(')) == t) return true;
-  if(t.find('(') != std::string::npos && t.substr(0, t.find('(')) == s) return true;
-  return false;
+  return s == t || base_name(s) == t || base_name(t) == s;
+}
+// NameTable の番号どうしで比べる
+bool almost_same(const int s, const int t){
+  return s == t || names.base(s) == t || names.base(t) == s;
 }
 
 // 読みを推測する、路線名までの一致判定は行わない
 void link_stations_name(std::vector<std::pair<int, int>> &main_sub_station_pairs, std::vector<const Station*> &unknown_stations){
-  std::map<std::string, std::vector<const Station*>> name_map;
+  std::vector<std::vector<const Station*>> name_map(names.size()); // 駅名の番号ごとの駅
+  std::vector<const Station*> candidates; // 新幹線以外の駅(ekispert_data.stations の順)
   for(const auto &station : ekispert_data.stations){
-    name_map[station.info->name].emplace_back(&station);
+    name_map[station.info->name_id].emplace_back(&station);
+    if(!names.shinkansen(station.rail->name_id)) candidates.emplace_back(&station);
   }
+  const StationGrid grid(candidates);
+  std::vector<int> near;
   for(const auto &station : eki_data.stations){
-    if(name_map.count(station.info->name)){
+    if(!name_map[station.info->name_id].empty()){
       const Station *min_st = &ekispert_data.stations.front();
       double min_dist = 1e9;
-      for(const auto st : name_map[station.info->name]){
-        if(st->rail->name.find("新幹線") != std::string::npos) continue;
-        const double d = station.pos.dist_km(st->pos) + str_dist(station.rail->name, st->rail->name) * 0.1;
+      for(const auto st : name_map[station.info->name_id]){
+        if(names.shinkansen(st->rail->name_id)) continue;
+        const double d = station.pos.dist_km(st->pos) + str_dist(station.rail->name_chars, st->rail->name_chars) * 0.1;
         if(min_dist > d){
           min_dist = d;
           min_st = st;
@@ -351,17 +1037,31 @@ void link_stations_name(std::vector<std::pair<int, int>> &main_sub_station_pairs
       main_sub_station_pairs.emplace_back(station.code, min_st->code);
       continue;
     }
+    // 駅名と路線名の一致で最大2km引かれるので,近くの駅の値 bound より小さくなりうるのは dist_km が bound+2 以下の駅だけ
+    // その駅を全駅のときと同じ順に調べるので,同じ値の駅があっても結果は変わらない
+    auto score = [&](const Station *sta){
+      return station.pos.dist_km(sta->pos) - almost_same(station.info->name_id, sta->info->name_id) - almost_same(station.rail->name_id, sta->rail->name_id);
+    };
+    double bound = 1e9;
+    grid.nearest_ring(station.pos, near);
+    for(const int i : near) chmin(bound, score(candidates[i]));
+    if(bound < 1e9){
+      grid.query(station.pos, bound + 2, near);
+    }else{
+      // 近くの駅の値が NaN (同じ座標で acos の引数が1を超える)ばかりのときは全駅を調べる
+      near.resize(candidates.size());
+      for(int i = 0; i < (int)candidates.size(); i++) near[i] = i;
+    }
     const Station *min_st = &ekispert_data.stations.front();
     double min_dist = 1e9;
-    for(const auto &sta : ekispert_data.stations){
-      if(sta.rail->name.find("新幹線") != std::string::npos) continue;
-      const double d = station.pos.dist_km(sta.pos) - almost_same(station.info->name, sta.info->name) - almost_same(station.rail->name, sta.rail->name);
+    for(const int i : near){
+      const double d = score(candidates[i]);
       if(min_dist > d){
         min_dist = d;
-        min_st = &sta;
+        min_st = candidates[i];
       }
     }
-    if(min_dist >= 0.03 && station.info->name != min_st->info->name){
+    if(min_dist >= 0.03 && station.info->name_id != min_st->info->name_id){
       unknown_stations.emplace_back(&station);
     }else{
       main_sub_station_pairs.emplace_back(station.code, min_st->code);
@@ -369,23 +1069,32 @@ void link_stations_name(std::vector<std::pair<int, int>> &main_sub_station_pairs
   }
 }
 
+// --stats のときに link_railways_color で路線ごとに集める時間と数
+struct RailwayLinkStats {
+  const Railway *railway;
+  int station_num;
+  int compared_railways; // 比べた駅すぱあとの路線の数
+  long long dist_km_calls;
+  double ms;
+};
+
 // 2津のデータの同じ路線の対応をとる
+// railway_stats が nullptr でなければ駅データ.jpの路線ごとの時間と数を入れる
 void link_railways_color(
   std::vector<std::pair<int, int>> &main_sub_railway_pairs,
   std::vector<const Railway*> &unknown_railways,
-  const std::vector<std::pair<int, int>> &main_sub_station_pairs
+  const std::vector<std::pair<int, int>> &main_sub_station_pairs,
+  std::vector<RailwayLinkStats> *railway_stats = nullptr
 ){
+  // 同じ順に並べた2つの路線の駅の,順に組にした駅の距離の平均
   auto calc_avg_dist = [](
-    std::vector<const Station*> &stas1,
-    std::vector<const Station*> &stas2,
-    bool(*comp)(const Station*, const Station*)
+    const std::vector<const Station*> &stas1,
+    const std::vector<const Station*> &stas2
   ) -> double {
     assert(stas1.size() == stas2.size());
-    std::sort(stas1.begin(), stas1.end(), comp);
-    std::sort(stas2.begin(), stas2.end(), comp);
     double avg_dist = 0;
     for(int i = 0; i < (int)stas1.size(); i++){
-      if(almost_same(stas1[i]->info->name, stas2[i]->info->name)){
+      if(almost_same(stas1[i]->info->name_id, stas2[i]->info->name_id)){
         continue;
       }
       avg_dist += stas1[i]->pos.dist_km(stas2[i]->pos);
@@ -393,37 +1102,211 @@ void link_railways_color(
     avg_dist /= stas1.size();
     return avg_dist;
   };
+  // stas1 の駅ごとに,使っていない stas2 の駅を順に見て,近いか駅名が一致すれば選ぶ
+  // 結果は最後に駅名が一致した駅(なければ stas2[0])から後ろの駅で dist_km が小さくなるものを順に選ぶのと同じなので,
+  // 駅名の一致は '(' より前が同じ駅だけを,近い駅は stas2 の k-d 木で弦の長さが最小に近いものだけを dist_km で比べる
+  // dist_km の誤差より十分大きい幅をとるので選ぶ駅は変わらない(ほぼ同じ点では dist_km が NaN になるので必ず比べる)
   auto calc_nearest_dist = [](
     const std::vector<const Station*> &stas1,
-    const std::vector<const Station*> &stas2
+    const std::vector<const Station*> &stas2,
+    const StationDatabase &data2
   ) -> double {
-    std::set<int> used;
+    constexpr double SAME_POINT_CHORD2 = 1e-12; // 弦の長さ 1e-6 (約6m) 以下
+    constexpr double CHORD_MARGIN = 1e-7;
+    const int n = stas2.size();
+    std::vector<double> xs(n), ys(n), zs(n);
+    for(int j = 0; j < n; j++){
+      const int idx = stas2[j]->index;
+      xs[j] = data2.unit_x[idx];
+      ys[j] = data2.unit_y[idx];
+      zs[j] = data2.unit_z[idx];
+    }
+    UnusedStationTree tree(xs.data(), ys.data(), zs.data(), n);
+    // (駅名の '(' より前の名前の番号, stas2 での位置) の昇順
+    std::vector<std::pair<int, int>> bases(n);
+    for(int j = 0; j < n; j++) bases[j] = { names.base(stas2[j]->info->name_id), j };
+    std::sort(bases.begin(), bases.end());
+    std::vector<int> near;
     double avg_dist = 0;
     for(const auto station : stas1){
-      const Station *min_st = stas2[0];
-      for(const auto sta : stas2){
-        if(used.count(sta->code)) continue;
-        if(station->pos.dist_km(min_st->pos) > station->pos.dist_km(sta->pos) || almost_same(station->info->name, sta->info->name)) min_st = sta;
+      int start = -1;
+      const int base = names.base(station->info->name_id);
+      for(auto it = std::upper_bound(bases.begin(), bases.end(), std::make_pair(base, INT_MAX)); it != bases.begin(); ){
+        --it;
+        if(it->first != base) break;
+        if(tree.used(it->second)) continue;
+        if(almost_same(station->info->name_id, stas2[it->second]->info->name_id)){
+          start = it->second;
+          break;
+        }
+      }
+      int min_j = std::max(start, 0);
+      double qx, qy, qz;
+      station->pos.unit_vector(qx, qy, qz);
+      const double best = tree.nearest(qx, qy, qz, start + 1, SAME_POINT_CHORD2);
+      const double limit = best < 1e9 ? (std::sqrt(best) + CHORD_MARGIN) * (std::sqrt(best) + CHORD_MARGIN) : SAME_POINT_CHORD2;
+      tree.query(qx, qy, qz, start + 1, limit, near);
+      double min_dist = station->pos.dist_km(stas2[min_j]->pos);
+      for(const int j : near){
+        const double d = station->pos.dist_km(stas2[j]->pos);
+        if(min_dist > d){
+          min_dist = d;
+          min_j = j;
+        }
       }
-      if(!almost_same(station->info->name, min_st->info->name)){
-        avg_dist += station->pos.dist_km(min_st->pos);
+      if(!almost_same(station->info->name_id, stas2[min_j]->info->name_id)){
+        avg_dist += station->pos.dist_km(stas2[min_j]->pos);
       }
-      used.insert(min_st->code);
+      tree.remove(min_j);
     }
     avg_dist /= stas1.size();
     return avg_dist;
   };
 
-  for(const auto &main_railway : eki_data.railways){
-     auto &main_railway_stations = eki_data.get_railway_stations(main_railway.code);
+  // 路線の全駅での一致判定で駅を並べる順(並べ替えた結果は後の判定や処理からも見える)
+  bool(*const station_orders[])(const Station*, const Station*) = {
+    [](const auto a, const auto b){ return a->pos < b->pos; },
+    [](const auto a, const auto b){ return a->pos.lat < b->pos.lat; },
+    [](const auto a, const auto b){ return a->pos.lng < b->pos.lng; },
+    [](const auto a, const auto b){ return a->pos.lat+a->pos.lng < b->pos.lat+b->pos.lng; },
+    [](const auto a, const auto b){ return a->info->name < b->info->name; },
+  };
+  // 駅の並びに station_orders の並べ替えを順にしたときの各段階の並び
+  // 並べ替えは毎回同じ順から始まることがほとんどなので,始めの並びごとに覚えておく(std::sort は同じ値の駅の順が始めの並びで変わる)
+  struct SortedOrders {
+    std::vector<const Station*> from;
+    std::vector<const Station*> orders[std::size(station_orders)];
+  };
+  std::map<const std::vector<const Station*>*, std::vector<SortedOrders>> sorted_orders_cache;
+  auto sorted_orders = [&](const std::vector<const Station*> &stas) -> const SortedOrders& {
+    auto &cache = sorted_orders_cache[&stas];
+    for(const auto &x : cache){
+      if(x.from == stas) return x;
+    }
+    SortedOrders &res = cache.emplace_back();
+    res.from = stas;
+    std::vector<const Station*> cur = stas;
+    for(int k = 0; k < (int)std::size(station_orders); k++){
+      std::sort(cur.begin(), cur.end(), station_orders[k]);
+      res.orders[k] = cur;
+    }
+    return res;
+  };
+  // 路線の駅の単位ベクトルを囲む箱(座標が有限でない駅があれば valid = false)
+  struct UnitBox {
+    double lo[3] = { 1e9, 1e9, 1e9 }, hi[3] = { -1e9, -1e9, -1e9 };
+    bool valid = true;
+  };
+  auto make_box = [](const std::vector<const Station*> &stas, const StationDatabase &data){
+    UnitBox box;
+    for(const auto sta : stas){
+      const double v[3] = { data.unit_x[sta->index], data.unit_y[sta->index], data.unit_z[sta->index] };
+      for(int k = 0; k < 3; k++){
+        if(!std::isfinite(v[k])) box.valid = false;
+        chmin(box.lo[k], v[k]);
+        chmax(box.hi[k], v[k]);
+      }
+    }
+    return box;
+  };
+  // 2つの箱の点どうしの弦の長さの下限
+  auto box_gap = [](const UnitBox &a, const UnitBox &b){
+    double gap2 = 0;
+    for(int k = 0; k < 3; k++){
+      const double d = std::max({ 0.0, a.lo[k] - b.hi[k], b.lo[k] - a.hi[k] });
+      gap2 += d * d;
+    }
+    return std::sqrt(gap2);
+  };
+  // stas1 の駅ごとの stas2 の最も近い駅までの弦の長さの和
+  auto nearest_chord_sum = [](
+    const std::vector<const Station*> &stas1, const StationDatabase &data1,
+    const std::vector<const Station*> &stas2, const StationDatabase &data2
+  ){
+    const int n = stas2.size();
+    std::vector<double> xs(n), ys(n), zs(n), chord2(n);
+    for(int j = 0; j < n; j++){
+      const int idx = stas2[j]->index;
+      xs[j] = data2.unit_x[idx];
+      ys[j] = data2.unit_y[idx];
+      zs[j] = data2.unit_z[idx];
+    }
+    double sum = 0;
+    for(const auto sta : stas1){
+      const int idx = sta->index;
+      chord2_batch(xs.data(), ys.data(), zs.data(), n, data1.unit_x[idx], data1.unit_y[idx], data1.unit_z[idx], chord2.data());
+      sum += std::sqrt(*std::min_element(chord2.begin(), chord2.end()));
+    }
+    return sum;
+  };
+
+  // 駅すぱあとの路線(ekispert_data.railways の位置)の転置インデックス
+  // 各判定で一致しうる路線だけを位置の順に調べるので,最初に一致する路線は全路線を順に調べたときと変わらない
+  const int sub_num = ekispert_data.railways.size();
+  std::map<std::pair<int, int>, std::vector<int>> sub_by_rail_name; // (路線名, 会社名)
+  std::map<int, std::vector<int>> sub_by_single_name; // 1路線だけの駅の駅名
+  std::map<int, std::vector<int>> sub_by_size; // 駅の数
+  std::map<int, std::vector<int>> sub_by_base_name; // 駅名の '(' より前
+  std::vector<UnitBox> sub_boxes(sub_num);
+  for(int j = 0; j < sub_num; j++){
+    const auto &sub_railway_stations = ekispert_data.get_railway_stations(ekispert_data.railways[j].code);
+    auto add = [j](std::vector<int> &list){
+      if(list.empty() || list.back() != j) list.emplace_back(j);
+    };
+    for(const auto sta : sub_railway_stations){
+      add(sub_by_rail_name[{ sta->rail->name_id, sta->rail->company->name_id }]);
+      if(sta->info->stationCnt == 1) add(sub_by_single_name[sta->info->name_id]);
+      add(sub_by_base_name[names.base(sta->info->name_id)]);
+    }
+    sub_by_size[sub_railway_stations.size()].emplace_back(j);
+    sub_boxes[j] = make_box(sub_railway_stations, ekispert_data);
+  }
+  static const std::vector<int> no_candidates;
+  auto find_list = [](const auto &index, const auto &key) -> const std::vector<int>& {
+    const auto it = index.find(key);
+    return it == index.end() ? no_candidates : it->second;
+  };
+  // list の中で cur より後ろの最初の位置
+  auto next_of = [](const std::vector<int> &list, const int cur){
+    const auto it = std::upper_bound(list.begin(), list.end(), cur);
+    return it == list.end() ? INT_MAX : *it;
+  };
+  std::vector<int> shares_name(sub_num, -1); // 駅名の '(' より前が一致する駅がある路線に main の位置を入れる
+
+  for(int m = 0; m < (int)eki_data.railways.size(); m++){
+    const auto &main_railway = eki_data.railways[m];
+    auto &main_railway_stations = eki_data.get_railway_stations(main_railway.code);
     const auto main_first = main_railway_stations[0];
     bool ok = false;
+    StatsClock::time_point start;
+    const long long dist_km_calls = counters.dist_km_calls;
+    int compared_railways = 0;
+    if(railway_stats) start = StatsClock::now();
+
+    const auto &rail_name_list = find_list(sub_by_rail_name, std::make_pair(main_first->rail->name_id, main_first->rail->company->name_id));
+    const auto &size_list = find_list(sub_by_size, (int)main_railway_stations.size());
+    for(const auto station : main_railway_stations){
+      for(const int j : find_list(sub_by_base_name, names.base(station->info->name_id))) shares_name[j] = m;
+    }
+    const UnitBox main_box = make_box(main_railway_stations, eki_data);
+    // 1路線だけの駅での一致判定は,今の並びで最初の1路線だけの駅の駅名が sub の1路線だけの駅にあるかと同じ
+    auto single_name_list = [&]() -> const std::vector<int>& {
+      for(const auto station : main_railway_stations){
+        if(station->info->stationCnt == 1) return find_list(sub_by_single_name, station->info->name_id);
+      }
+      return no_candidates;
+    };
+    const std::vector<int> *single_list = &single_name_list();
 
-    for(const auto &sub_railway : ekispert_data.railways){
+    for(int cur = -1; ; ){
+      cur = std::min({ next_of(rail_name_list, cur), next_of(*single_list, cur), next_of(size_list, cur) });
+      if(cur == INT_MAX) break;
+      const auto &sub_railway = ekispert_data.railways[cur];
+      compared_railways++;
       auto &sub_railway_stations = ekispert_data.get_railway_stations(sub_railway.code);
       const auto sub_first = sub_railway_stations[0];
       // 名前の一致判定
-      if(main_first->rail->name == sub_first->rail->name && main_first->rail->company->name == sub_first->rail->company->name){
+      if(main_first->rail->name_id == sub_first->rail->name_id && main_first->rail->company->name_id == sub_first->rail->company->name_id){
         main_sub_railway_pairs.emplace_back(main_railway.code, sub_railway.code);
         ok = true;
         break;
@@ -434,7 +1317,7 @@ void link_railways_color(
         if(station->info->stationCnt != 1) continue;
         for(const auto sta : sub_railway_stations){
           if(sta->info->stationCnt != 1) continue;
-          if(station->info->name == sta->info->name){
+          if(station->info->name_id == sta->info->name_id){
             found = true;
             break;
           }
@@ -448,19 +1331,43 @@ void link_railways_color(
       }
       // 路線の全駅での一致判定
       if(main_railway_stations.size() != sub_railway_stations.size()) continue;
+      // 駅名が almost_same になる組がなければどの距離も駅の間の dist_km の平均で,各駅から相手の最も近い駅までの距離の平均以上になる
+      // 箱の間の弦の長さか,駅ごとの最も近い駅までの弦の長さから 1km を超えるとわかれば並べ替えだけする
+      // (dist_km は弦の長さ * 6371 以上,誤差より十分大きい幅をとる)
+      auto far_apart = [&](){
+        if(shares_name[cur] == m || !main_box.valid || !sub_boxes[cur].valid) return false;
+        constexpr double LIMIT = (1.0 + 1e-3) / 6371;
+        if(box_gap(main_box, sub_boxes[cur]) > LIMIT) return true;
+        const double n = main_railway_stations.size();
+        return nearest_chord_sum(main_railway_stations, eki_data, sub_railway_stations, ekispert_data) / n > LIMIT
+          && nearest_chord_sum(sub_railway_stations, ekispert_data, main_railway_stations, eki_data) / n > LIMIT;
+      };
+      if(far_apart()){
+        main_railway_stations = sorted_orders(main_railway_stations).orders[std::size(station_orders) - 1];
+        sub_railway_stations = sorted_orders(sub_railway_stations).orders[std::size(station_orders) - 1];
+        single_list = &single_name_list();
+        continue;
+      }
       double min_avg_dist = 1e9;
-      chmin(min_avg_dist, calc_avg_dist(main_railway_stations, sub_railway_stations, [](const auto a, const auto b){ return a->pos < b->pos; }));
-      chmin(min_avg_dist, calc_avg_dist(main_railway_stations, sub_railway_stations, [](const auto a, const auto b){ return a->pos.lat < b->pos.lat; }));
-      chmin(min_avg_dist, calc_avg_dist(main_railway_stations, sub_railway_stations, [](const auto a, const auto b){ return a->pos.lng < b->pos.lng; }));
-      chmin(min_avg_dist, calc_avg_dist(main_railway_stations, sub_railway_stations, [](const auto a, const auto b){ return a->pos.lat+a->pos.lng < b->pos.lat+b->pos.lng; }));
-      chmin(min_avg_dist, calc_avg_dist(main_railway_stations, sub_railway_stations, [](const auto a, const auto b){ return a->info->name < b->info->name; }));
-      chmin(min_avg_dist, calc_nearest_dist(main_railway_stations, sub_railway_stations));
-      chmin(min_avg_dist, calc_nearest_dist(sub_railway_stations, main_railway_stations));
+      const auto &main_orders = sorted_orders(main_railway_stations);
+      const auto &sub_orders = sorted_orders(sub_railway_stations);
+      for(int k = 0; k < (int)std::size(station_orders); k++){
+        chmin(min_avg_dist, calc_avg_dist(main_orders.orders[k], sub_orders.orders[k]));
+      }
+      main_railway_stations = main_orders.orders[std::size(station_orders) - 1];
+      sub_railway_stations = sub_orders.orders[std::size(station_orders) - 1];
+      chmin(min_avg_dist, calc_nearest_dist(main_railway_stations, sub_railway_stations, ekispert_data));
+      chmin(min_avg_dist, calc_nearest_dist(sub_railway_stations, main_railway_stations, eki_data));
       if(min_avg_dist <= 1.0){
         main_sub_railway_pairs.emplace_back(main_railway.code, sub_railway.code);
         ok = true;
         break;
       }
+      single_list = &single_name_list();
+    }
+    if(railway_stats){
+      railway_stats->push_back({ &main_railway, (int)main_railway_stations.size(), compared_railways,
+        counters.dist_km_calls - dist_km_calls, elapsed_ms(start, StatsClock::now()) });
     }
     if(ok) continue;
     unknown_railways.emplace_back(main_first->rail);
@@ -471,13 +1378,16 @@ void link_railways_color(
   for(const auto &x : main_sub_station_pairs){
     same_station_pairs[x.first] = x.second;
   }
+  std::map<int, std::vector<const Station*>> stations_by_rail_name; // eki_data.stations の順
+  for(const auto &station : eki_data.stations){
+    stations_by_rail_name[station.rail->name_id].emplace_back(&station);
+  }
   // 全部一致していれば対応付ける
   for(auto &railway : unknown_railways){
     std::set<const Railway*> cnt;
-    for(const auto &station : eki_data.stations){
-      if(station.rail->name != railway->name) continue;
-      if(!same_station_pairs.count(station.code)) continue;
-      const int sub_code = same_station_pairs[station.code];
+    for(const auto station : stations_by_rail_name[railway->name_id]){
+      if(!same_station_pairs.count(station->code)) continue;
+      const int sub_code = same_station_pairs[station->code];
       cnt.insert(ekispert_data.get_station(sub_code)->rail);
     }
     if((int)cnt.size() != 1) continue;
@@ -512,8 +1422,8 @@ void output_shinkansen_data(
     "奥羽線", "上越線", "北陸線", "田沢湖線"
   };
   // kokudo_route_data only
-  auto is_shinkansen_railway = [&](const std::string &railwayName) -> bool {
-    return railwayName.find("新幹線") != std::string::npos || valid_railNames.count(railwayName);
+  auto is_shinkansen_railway = [&](const Railway &railway) -> bool {
+    return names.shinkansen(railway.name_id) || valid_railNames.count(railway.name);
   };
 
   for(const auto &x : shinkansen_data){
@@ -528,10 +1438,31 @@ void output_shinkansen_data(
     }
   }
 
-  auto find_almost_same_name_station = [](const Station *station, std::vector<Station> &stations) -> Station* {
+  // 駅名の '(' より前ごとの eki_data.stations の位置(stations の順)
+  // almost_same な駅は同じ名前の中にしかないので,全駅を見たときと同じ駅が同じ順に見つかる
+  // 駅を追加すると stations が伸びるので,ポインタではなく位置で持ち,追加した駅も入れていく
+  std::unordered_map<int, std::vector<int>> eki_by_name;
+  for(int i = 0; i < (int)eki_data.stations.size(); i++){
+    eki_by_name[names.base(eki_data.stations[i].info->name_id)].emplace_back(i);
+  }
+  // 国土数値情報の新幹線(と valid_railNames)の路線の駅だけを同じように分ける
+  std::set<const Railway*> shinkansen_route_railways;
+  for(const auto &railway : kokudo_route_data.railways){
+    if(is_shinkansen_railway(railway)) shinkansen_route_railways.insert(&railway);
+  }
+  std::unordered_map<int, std::vector<Station*>> route_by_name;
+  for(auto &sta : kokudo_route_data.stations){
+    if(!shinkansen_route_railways.count(sta.rail)) continue;
+    route_by_name[names.base(sta.info->name_id)].emplace_back(&sta);
+  }
+
+  auto find_almost_same_name_station = [&eki_by_name](const Station *station) -> Station* {
     Station *min_st = nullptr;
-    for(auto &sta : stations){
-      if(!almost_same(station->info->name, sta.info->name)) continue;
+    const auto it = eki_by_name.find(names.base(station->info->name_id));
+    if(it == eki_by_name.end()) return nullptr;
+    for(const int i : it->second){
+      auto &sta = eki_data.stations[i];
+      if(!almost_same(station->info->name_id, sta.info->name_id)) continue;
       if(!min_st || station->pos.dist_km(min_st->pos) > station->pos.dist_km(sta.pos)){
         min_st = &sta;
       }
@@ -540,7 +1471,7 @@ void output_shinkansen_data(
   };
 
   for(const auto &rail : ekispert_data.railways){
-    if(rail.name.find("新幹線") == std::string::npos) continue;
+    if(!names.shinkansen(rail.name_id)) continue;
     const std::string railName = rail.name.substr(2);
     const Railway *railway_ptr = nullptr;
     for(const auto &r : eki_data.railways){
@@ -555,7 +1486,7 @@ void output_shinkansen_data(
     // 新幹線駅の追加
     for(const auto station : ekispert_data.get_railway_stations(rail.code)){
       if(station->info->name == "越後湯沢" && rail.name.find("上越新幹線(") != std::string::npos) continue;
-      const Station *min_st = find_almost_same_name_station(station, eki_data.stations);
+      const Station *min_st = find_almost_same_name_station(station);
 
       if(min_st && min_st->pos.dist_km(station->pos) <= 1.5){
         min_st->info->stationCnt++;
@@ -568,27 +1499,32 @@ void output_shinkansen_data(
         group->stationCnt++;
         eki_data.stations.emplace_back(10000000 + station->code, group, railway_ptr, station->pos);
       }
+      eki_by_name[names.base(eki_data.stations.back().info->name_id)].emplace_back(eki_data.stations.size() - 1);
       main_sub_station_pairs.emplace_back(eki_data.stations.back().code, station->code);
     }
   }
 
-  auto find_main_data_shinkansen = [](const Station *station) -> std::vector<Station*> {
+  auto find_main_data_shinkansen = [&eki_by_name](const Station *station) -> std::vector<Station*> {
     std::vector<Station*> res;
-    for(auto &sta : eki_data.stations){
-      if(sta.rail->name.find("新幹線") == std::string::npos) continue;
-      if(almost_same(station->info->name, sta.info->name)){
+    const auto it = eki_by_name.find(names.base(station->info->name_id));
+    if(it == eki_by_name.end()) return res;
+    for(const int i : it->second){
+      auto &sta = eki_data.stations[i];
+      if(!names.shinkansen(sta.rail->name_id)) continue;
+      if(almost_same(station->info->name_id, sta.info->name_id)){
         res.emplace_back(&sta);
       }
     }
     return res;
   };
 
-  auto find_similar_route_stations = [&is_shinkansen_railway](const Station *station) -> std::vector<Station*> {
+  auto find_similar_route_stations = [&route_by_name](const Station *station) -> std::vector<Station*> {
     std::vector<Station*> res;
-    for(auto &sta : kokudo_route_data.stations){
-      if(!is_shinkansen_railway(sta.rail->name)) continue;
-      if(almost_same(station->info->name, sta.info->name)){
-        res.emplace_back(&sta);
+    const auto it = route_by_name.find(names.base(station->info->name_id));
+    if(it == route_by_name.end()) return res;
+    for(const auto sta : it->second){
+      if(almost_same(station->info->name_id, sta->info->name_id)){
+        res.emplace_back(sta);
       }
     }
     return res;
@@ -598,26 +1534,31 @@ void output_shinkansen_data(
 
   // 新幹線の隣駅を求める
   // (新幹線の駅では違う場所で同じ駅名は存在しないとする)
+  HopDistanceIndex left_hops(kokudo_route_data, &Station::left), right_hops(kokudo_route_data, &Station::right);
   for(const auto &railway : eki_data.railways){
-    if(railway.name.find("新幹線") == std::string::npos) continue;
+    if(!names.shinkansen(railway.name_id)) continue;
     auto &one_railway_stations = eki_data.get_railway_stations_mut(railway.code);
+    std::vector<std::vector<Station*>> similar_route_stations;
+    for(const auto station : one_railway_stations) similar_route_stations.emplace_back(find_similar_route_stations(station));
     // 2駅が隣駅かどうか
-    for(auto station : one_railway_stations){
-      auto routes_stations = find_similar_route_stations(station);
+    for(int i = 0; i < (int)one_railway_stations.size(); i++){
+      const auto station = one_railway_stations[i];
+      const auto &routes_stations = similar_route_stations[i];
       int min_left_dist = 100000;
       Station *min_left_st = nullptr;
       int min_right_dist = 100000;
       Station *min_right_st = nullptr;
-      for(auto sta : one_railway_stations){
+      for(int j = 0; j < (int)one_railway_stations.size(); j++){
+        const auto sta = one_railway_stations[j];
         if(station == sta) continue;
-        const auto routes_stas = find_similar_route_stations(sta);
+        const auto &routes_stas = similar_route_stations[j];
         for(const auto routes_station : routes_stations){
           for(const auto routes_sta : routes_stas){
-            const int left_dist = routes_station->calc_left_station_dist(routes_sta);
+            const int left_dist = left_hops.dist(routes_station, routes_sta);
             if(left_dist >= 1 && chmin(min_left_dist, left_dist)){
               min_left_st = sta;
             }
-            const int right_dist = routes_station->calc_right_station_dist(routes_sta);
+            const int right_dist = right_hops.dist(routes_station, routes_sta);
             if(right_dist >= 1 && chmin(min_right_dist, right_dist)){
               min_right_st = sta;
             }
@@ -637,7 +1578,7 @@ void output_shinkansen_data(
 
   // 重複削除
   for(auto &station : eki_data.stations){
-    if(station.rail->name.find("新幹線") == std::string::npos) continue;
+    if(!names.shinkansen(station.rail->name_id)) continue;
     std::sort(station.left.begin(), station.left.end());
     station.left.erase(std::unique(station.left.begin(), station.left.end()), station.left.end());
     std::sort(station.right.begin(), station.right.end());
@@ -649,7 +1590,7 @@ void output_shinkansen_data(
   std::cout << "    \"railways\": [\n";
   bool is_first = true;
   for(const auto &rail : eki_data.railways){
-    if(rail.name.find("新幹線") == std::string::npos) continue;
+    if(!names.shinkansen(rail.name_id)) continue;
     if(!is_first) std::cout << ",\n";
     is_first = false;
     std::cout << "      {\n";
@@ -673,7 +1614,7 @@ void output_shinkansen_data(
     std::cout << "]";
   };
   for(const auto &station : eki_data.stations){
-    if(station.rail->name.find("新幹線") == std::string::npos) continue;
+    if(!names.shinkansen(station.rail->name_id)) continue;
     if(station.left.empty() && station.right.empty()) continue;
     if(!is_first) std::cout << ",\n";
     is_first = false;
@@ -694,32 +1635,82 @@ void output_shinkansen_data(
   std::cout << "  },\n";
 }
 
-int main(){
+// --stats のときに標準エラー出力に書き出すjson
+//   phasesMs        : 処理の段階ごとの経過時間(ms)
+//   counters        : 駅と路線の数,str_dist,dist_km を呼んだ回数など
+//   slowestRailways : link_railways_color で時間のかかった駅データ.jpの路線
+void output_stats(std::ostream &os, const PhaseTimer &timer, const std::vector<RailwayLinkStats> &railway_stats){
+  constexpr int SLOWEST_RAILWAY_NUM = 10;
+  os << "{\n";
+  timer.write_json(os, "  ");
+  os << ",\n";
+  os << "  \"counters\": { \"ekispertStations\": " << ekispert_data.stations.size() << ", \"ekiStations\": " << eki_data.stations.size()
+     << ", \"kokudoStations\": " << kokudo_route_data.stations.size() << ", \"ekispertRailways\": " << ekispert_data.railways.size()
+     << ", \"ekiRailways\": " << eki_data.railways.size() << ", \"strDistCalls\": " << counters.str_dist_calls
+     << ", \"distKmCalls\": " << counters.dist_km_calls << ", \"stationDistBfs\": " << counters.station_dist_bfs << " },\n";
+  std::vector<double> railway_ms;
+  for(const auto &stats : railway_stats) railway_ms.push_back(stats.ms);
+  os << "  \"slowestRailways\": [";
+  bool is_first = true;
+  for(const int i : slowest_indices(railway_ms, SLOWEST_RAILWAY_NUM)){
+    const RailwayLinkStats &stats = railway_stats[i];
+    os << (is_first ? "\n" : ",\n") << "    { \"railwayCode\": " << stats.railway->code << ", \"railwayName\": ";
+    is_first = false;
+    write_json_string(os, stats.railway->name);
+    os << ", \"ms\": " << stats.ms << ", \"stations\": " << stats.station_num << ", \"comparedRailways\": " << stats.compared_railways
+       << ", \"distKmCalls\": " << stats.dist_km_calls << " }";
+  }
+  os << (is_first ? "]\n" : "\n  ]\n");
+  os << "}\n";
+}
+
+// ./datalink [--stats] < input.txt
+//   --stats : 段階ごとの時間,時間のかかった路線,呼び出しの回数などを標準エラー出力にjsonで出力する(output_stats を参照)
+// bench_datalink.cpp はこのファイルを DATALINK_NO_MAIN を定義して include する
+#ifndef DATALINK_NO_MAIN
+int main(int argc, char *argv[]){
   std::cin.tie(nullptr);
   std::ios::sync_with_stdio(false);
+  bool show_stats = false;
+  for(int i = 1; i < argc; i++){
+    const std::string arg = argv[i];
+    if(arg == "--stats"){
+      show_stats = true;
+    }else{
+      std::cerr << "Error: invalid argument " << arg << "\n";
+      return 1;
+    }
+  }
+  PhaseTimer timer(show_stats);
 
   input();
+  timer.lap("input");
 
   eki_data.build();
   ekispert_data.build();
   kokudo_route_data.build();
+  timer.lap("build");
 
   std::vector<std::pair<int, int>> main_sub_station_pairs;
   std::vector<const Station*> unknown_stations;
 
   link_stations_name(main_sub_station_pairs, unknown_stations);
+  timer.lap("linkStationsName");
 
 
   std::vector<std::pair<int, int>> main_sub_railway_pairs, main_route_railway_pairs;
   std::vector<const Railway*> unknown_railways;
+  std::vector<RailwayLinkStats> railway_stats;
 
-  link_railways_color(main_sub_railway_pairs, unknown_railways, main_sub_station_pairs);
+  link_railways_color(main_sub_railway_pairs, unknown_railways, main_sub_station_pairs, show_stats ? &railway_stats : nullptr);
+  timer.lap("linkRailwaysColor");
 
 
   // output json
   std::cout << "{\n";
 
   output_shinkansen_data(main_sub_station_pairs, main_sub_railway_pairs);
+  timer.lap("shinkansen");
 
 
   std::cout << "  \"stationPairs\": [\n";
@@ -756,4 +1747,9 @@ int main(){
   std::cout << "]\n";
 
   std::cout << "}\n";
+  std::cout.flush();
+  timer.lap("output");
+
+  if(show_stats) output_stats(std::cerr, timer, railway_stats);
 }
+#endif
@@ -0,0 +1,343 @@
+// ベンチマーク用に calc と datalink の入力を合成する(国土交通省,駅データ.jp,駅すぱあとのデータは使わない)
+//   node gen-bench-data.js [--scale <路線の数>] [--seed <n>] [--out <dir>]
+// <dir>/railroad.txt と <dir>/input.txt を書き出す
+const fs = require("fs");
+const path = require("path");
+
+// 同じ seed なら同じデータになるようにする
+const create_random = (seed) => {
+  let state = seed >>> 0;
+  const next = () => {
+    state = (state + 0x6d2b79f5) >>> 0;
+    let t = state;
+    t = Math.imul(t ^ (t >>> 15), t | 1);
+    t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+  };
+  next.uniform = (a, b) => a + (b - a) * next();
+  next.int = (a, b) => a + Math.floor(next() * (b - a + 1)); // [a, b]
+  next.choice = (list) => list[Math.floor(next() * list.length)];
+  return next;
+};
+
+const round5 = (x) => Math.round(x * 1e5) / 1e5;
+const format_path = (line) =>
+  line.map(([lat, lng]) => `${lat.toFixed(5)} ${lng.toFixed(5)}`).join(" ");
+
+// 線路の形: 直線,環状,端にループのある線,分岐のある線
+const RAILWAY_KINDS = ["linear", "linear", "circle", "loop", "branch"];
+
+const make_main_line = (kind, random) => {
+  const lat = random.uniform(33, 41);
+  const lng = random.uniform(130, 140);
+  const n = random.int(30, 120);
+  const line = [];
+  if (kind === "circle") {
+    for (let i = 0; i < n; i++) {
+      const a = (2 * Math.PI * i) / n;
+      line.push([lat + 0.05 * Math.cos(a), lng + 0.05 * Math.sin(a)]);
+    }
+    line.push(line[0]);
+  } else {
+    const a = random.uniform(0, Math.PI);
+    for (let i = 0; i < n; i++) {
+      line.push([
+        lat + 0.002 * i * Math.cos(a) + random.uniform(-3e-4, 3e-4),
+        lng + 0.002 * i * Math.sin(a) + random.uniform(-3e-4, 3e-4),
+      ]);
+    }
+  }
+  return line.map(([a, b]) => [round5(a), round5(b)]);
+};
+
+// 終点から進行方向に膨らむ円を描いて終点に戻る
+const make_loop = (main) => {
+  const end = main[main.length - 1];
+  const prev = main[main.length - 3];
+  const d = Math.atan2(end[1] - prev[1], end[0] - prev[0]);
+  const [dx, dy] = [Math.cos(d), Math.sin(d)];
+  const [px, py] = [-dy, dx];
+  const loop = [end];
+  for (let i = 1; i < 40; i++) {
+    const t = (2 * Math.PI * i) / 40;
+    loop.push([
+      round5(end[0] + 0.03 * (px - px * Math.cos(t) + dx * Math.sin(t))),
+      round5(end[1] + 0.03 * (py - py * Math.cos(t) + dy * Math.sin(t))),
+    ]);
+  }
+  loop.push(end);
+  return loop;
+};
+
+// 本線の k 番目の頂点から斜めに分かれる支線
+const make_branch = (main, k, random) => {
+  const start = main[k];
+  const a =
+    Math.atan2(main[k + 1][1] - main[k - 1][1], main[k + 1][0] - main[k - 1][0]) +
+    random.choice([-0.5, 0.5]);
+  const branch = [start];
+  const n = random.int(20, 60);
+  for (let i = 1; i < n; i++) {
+    branch.push([
+      round5(start[0] + 0.002 * i * Math.cos(a)),
+      round5(start[1] + 0.002 * i * Math.sin(a)),
+    ]);
+  }
+  return branch;
+};
+
+// railroad.txt の形式(README.md を参照)
+const generate_railroad = (railway_num, random) => {
+  const stations = [];
+  const paths = [];
+  let station_code = 100000;
+  for (let id = 0; id < railway_num; id++) {
+    const kind = random.choice(RAILWAY_KINDS);
+    const lines = [make_main_line(kind, random)];
+    // 線路のデータから除く本線の頂点(データに記述されていない分岐点)
+    const hidden = new Set();
+    if (kind === "loop") lines.push(make_loop(lines[0]));
+    if (kind === "branch") {
+      // 分岐点どうしは本線を分けた区間ごとに1つずつ離して置く
+      const branch_num = random.int(1, 3);
+      const width = Math.floor((lines[0].length - 10) / branch_num);
+      for (let i = 0; i < branch_num; i++) {
+        const k = 5 + i * width + random.int(0, Math.max(0, width - 10));
+        if (random() < 0.5) {
+          // 分岐点が前後の頂点のちょうど中点になるように次の頂点を動かし,
+          // 本線からは分岐点を除いて線分の途中から支線が分かれるようにする
+          const main = lines[0];
+          main[k + 1] = [round5(2 * main[k][0] - main[k - 1][0]), round5(2 * main[k][1] - main[k - 1][1])];
+          hidden.add(k);
+        }
+        lines.push(make_branch(lines[0], k, random));
+      }
+    }
+
+    // 駅は線路の頂点を中心とする3点の線分
+    const railway_name = `路線${id}`;
+    const company = `会社${id % 7}`;
+    lines.forEach((line, li) => {
+      const step = random.int(6, 10);
+      for (let k = li > 0 ? 2 : 1; k + 1 < line.length; k += step) {
+        stations.push({
+          geometry: [line.slice(k - 1, k + 2)],
+          code: station_code,
+          id,
+          names: `${railway_name} ${company} 駅${station_code}`,
+        });
+        station_code++;
+      }
+    });
+
+    // 線路は3〜25点ごとの断片に分け,たまに同じ断片を重複させる
+    lines.forEach((all_line, li) => {
+      const line = li > 0 ? all_line : all_line.filter((_, k) => !hidden.has(k));
+      for (let i = 0; i < line.length - 1; ) {
+        const j = Math.min(line.length - 1, i + random.int(3, 25));
+        const fragment = line.slice(i, j + 1);
+        paths.push({ id, fragment });
+        if (random() < 0.05) paths.push({ id, fragment });
+        i = j;
+      }
+    });
+  }
+  for (let i = paths.length - 1; i > 0; i--) {
+    const j = Math.floor(random() * (i + 1));
+    [paths[i], paths[j]] = [paths[j], paths[i]];
+  }
+
+  const out = [String(stations.length), String(railway_num)];
+  stations.forEach((station) => {
+    out.push(String(station.geometry.length));
+    station.geometry.forEach((line) => {
+      out.push(String(line.length));
+      out.push(format_path(line));
+    });
+    out.push(`${station.code} ${station.id}`);
+    out.push(station.names);
+  });
+  out.push(String(paths.length));
+  paths.forEach(({ id, fragment }) => {
+    out.push(`${id} ${fragment.length}`);
+    out.push(format_path(fragment));
+  });
+  return out.join("\n") + "\n";
+};
+
+// datalink の入力(collect-data.js の input.txt)の形式
+// 駅すぱあと,駅データ.jp,国土交通省の順に,同じ路線網を少しずつ違う名前と座標で出力する
+const generate_datalink_input = (railway_num, random) => {
+  const base64 = (s) => Buffer.from(s).toString("base64");
+  const format_coord = ([lat, lng]) => `${lat.toFixed(6)} ${lng.toFixed(6)}`;
+
+  // 駅名の3割は他の路線と共有して乗換駅にする
+  const shared_names = new Array(railway_num * 8).fill().map((_, i) => `駅${i}`);
+  const shared_pos = new Map();
+  const railways = [];
+  for (let r = 0; r < railway_num; r++) {
+    const company_code = random.choice([3, 7, 8, 9, 10, 11, 12]);
+    const lat = random.uniform(33, 41);
+    const lng = random.uniform(130, 140);
+    const a = random.uniform(0, 2 * Math.PI);
+    const n = random.int(4, 40);
+    const stations = [];
+    for (let i = 0; i < n; i++) {
+      let name = random() < 0.3 ? random.choice(shared_names) : `駅R${r}S${i}`;
+      let pos;
+      if (shared_pos.has(name) && random() < 0.7) {
+        const p = shared_pos.get(name);
+        pos = [p[0] + random.uniform(-1e-3, 1e-3), p[1] + random.uniform(-1e-3, 1e-3)];
+      } else {
+        pos = [lat + 0.01 * i * Math.cos(a), lng + 0.01 * i * Math.sin(a)];
+        if (!shared_pos.has(name)) shared_pos.set(name, pos);
+      }
+      if (stations.some((station) => station.name === name)) name += `(${i})`;
+      stations.push({ name, pos });
+    }
+    railways.push({
+      name: `線${r}`,
+      company: `会社${company_code}`,
+      company_code,
+      stations,
+      jr_prefix: random() < 0.2,
+    });
+  }
+  const shinkansen = new Array(12).fill().map((_, i) => ({
+    name: `新${i}`,
+    pos: [35 + 0.1 * i, 137 + 0.1 * i],
+  }));
+  railways.push({
+    name: "在来線",
+    company: "会社3",
+    company_code: 3,
+    stations: shinkansen.slice(2, 7).map(({ name, pos }) => ({ name, pos: [pos[0] + 1e-3, pos[1]] })),
+    jr_prefix: false,
+  });
+
+  const emit = (stations, infos) => {
+    const out = [String(stations.length)];
+    stations.forEach((s) => {
+      out.push(
+        `${s.code} ${s.group} ${base64(s.name)} ${s.railway_code} ${base64(s.railway_name)} ${s.company_code} ${base64(s.company)} ${format_coord(s.pos)}`
+      );
+    });
+    out.push(String(infos.length));
+    infos.forEach(({ code, left, right }) => {
+      out.push(`${code} ${left.length} ${left.join(" ")} ${right.length} ${right.join(" ")}`);
+    });
+    return out;
+  };
+  // 駅名('('の前)ごとに駅グループのコードを振る
+  const group_codes = (base) => {
+    const codes = new Map();
+    return (name) => {
+      const key = name.split("(")[0];
+      if (!codes.has(key)) codes.set(key, base + codes.size);
+      return codes.get(key);
+    };
+  };
+  const linear_infos = (codes) =>
+    codes.map((code, i) => ({
+      code,
+      left: i > 0 ? [codes[i - 1]] : [],
+      right: i + 1 < codes.length ? [codes[i + 1]] : [],
+    }));
+
+  // 駅すぱあと: 駅が少し欠けていたり,駅名に括弧がついていたり,路線名に JR がついていたりする
+  const ekispert = [];
+  let group = group_codes(500000);
+  let code = 2000000;
+  railways.forEach((railway, r) => {
+    railway.stations.forEach(({ name, pos }) => {
+      if (random() < 0.05) return;
+      ekispert.push({
+        code: code++,
+        group: group(name),
+        name: random() < 0.05 ? `${name}(東京)` : name,
+        railway_code: 5000 + r,
+        railway_name: railway.jr_prefix ? `JR${railway.name}` : railway.name,
+        company_code: 100 + railway.company_code,
+        company: railway.company,
+        pos: [pos[0] + random.uniform(-2e-4, 2e-4), pos[1] + random.uniform(-2e-4, 2e-4)],
+      });
+    });
+  });
+  group = group_codes(600000);
+  shinkansen.forEach(({ name, pos }) => {
+    ekispert.push({
+      code: code++,
+      group: group(name),
+      name,
+      railway_code: 9999,
+      railway_name: "JR東海道新幹線",
+      company_code: 103,
+      company: "JR東海",
+      pos,
+    });
+  });
+
+  // 駅データ.jp: 隣駅は駅の順に並ぶ
+  const eki = [];
+  const eki_infos = [];
+  group = group_codes(1100000);
+  code = 1100000;
+  railways.forEach((railway, r) => {
+    const codes = railway.stations.map(({ name, pos }) => {
+      eki.push({
+        code,
+        group: group(name),
+        name,
+        railway_code: 11000 + r,
+        railway_name: railway.name,
+        company_code: railway.company_code,
+        company: railway.company,
+        pos,
+      });
+      return code++;
+    });
+    eki_infos.push(...linear_infos(codes));
+  });
+
+  // 国土交通省: 新幹線といくつかの在来線
+  const kokudo = [];
+  const kokudo_infos = [];
+  group = group_codes(0);
+  code = 0;
+  const add_kokudo_railway = (stations, railway_code, railway_name, company) => {
+    const codes = stations.map(({ name, pos }) => {
+      kokudo.push({ code, group: group(name), name, railway_code, railway_name, company_code: 1, company, pos });
+      return code++;
+    });
+    kokudo_infos.push(...linear_infos(codes));
+  };
+  add_kokudo_railway(shinkansen, 0, "東海道新幹線", "東海旅客鉄道");
+  railways.slice(0, 5).forEach((railway, r) => {
+    add_kokudo_railway(railway.stations, r + 1, railway.name, railway.company);
+  });
+
+  return [...emit(ekispert, []), ...emit(eki, eki_infos), ...emit(kokudo, kokudo_infos)].join("\n") + "\n";
+};
+
+const generate_bench_data = (out_dir, scale, seed) => {
+  const random = create_random(seed);
+  fs.mkdirSync(out_dir, { recursive: true });
+  fs.writeFileSync(path.join(out_dir, "railroad.txt"), generate_railroad(scale, random));
+  fs.writeFileSync(path.join(out_dir, "input.txt"), generate_datalink_input(scale, random));
+};
+
+exports.generate_bench_data = generate_bench_data;
+
+if (require.main === module) {
+  const options = { scale: 100, seed: 1, out: "data/bench" };
+  const args = process.argv.slice(2);
+  for (let i = 0; i < args.length; i++) {
+    const name = args[i].replace(/^--/, "");
+    if (!(name in options) || i + 1 >= args.length) {
+      console.error(`Error: invalid argument ${args[i]}`);
+      process.exit(1);
+    }
+    options[name] = name === "out" ? args[++i] : +args[++i];
+  }
+  generate_bench_data(options.out, options.scale, options.seed);
+}
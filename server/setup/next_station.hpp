@@ -0,0 +1,1419 @@
+// 国道交通省の線路データから隣駅を計算する処理
+// calc.cpp と next_station_addon.cpp で共通
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <map>
+#include <unordered_map>
+#include <stdexcept>
+#include <exception>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <thread>
+#include <atomic>
+#include "stats.hpp"
+
+constexpr double PI = 3.14159265358979323846;
+
+// 入力がおかしくて計算を続けられないときは例外を投げる(addon から呼ばれたときに Node のプロセスを落とさない)
+#define NEXT_STATION_CHECK(cond) \
+  do{ \
+    if(!(cond)) throw std::runtime_error(std::string("next_station.hpp:") + std::to_string(__LINE__) + ": check failed: " #cond); \
+  }while(0)
+
+struct UnionFind {
+  std::vector<int> d;
+  UnionFind(int n): n(n), d(n, -1){}
+  int root(int x){
+    NEXT_STATION_CHECK(0 <= x && x < n);
+    if(d[x] < 0) return x;
+    return d[x] = root(d[x]);
+  }
+  bool unite(int x, int y){
+    x = root(x);
+    y = root(y);
+    if(x == y) return false;
+    if(d[x] > d[y]) std::swap(x, y);
+    d[x] += d[y];
+    d[y] = x;
+    return true;
+  }
+  bool same(int x, int y){
+    return root(x) == root(y);
+  }
+  int size(int x){
+    return -d[root(x)];
+  }
+private:
+  int n;
+};
+
+struct Pos {
+  double lat,lng;
+  Pos() : lat(0), lng(0){}
+  Pos(const double a, const double b) : lat(a), lng(b){}
+  double dist_km(const Pos &a) const{
+    static constexpr double R = PI / 180;
+    return acos(cos(lat*R) * cos(a.lat*R) * cos(a.lng*R - lng*R) + sin(lat*R) * sin(a.lat*R)) * 6371;
+  }
+  double dist(const Pos &a) const{
+    return sqrt((lat-a.lat)*(lat-a.lat) + (lng-a.lng)*(lng-a.lng));
+  }
+  inline constexpr bool operator<(const Pos &a) const{
+    if(lat != a.lat) return lat < a.lat;
+    return lng < a.lng;
+  }
+  inline constexpr bool operator==(const Pos &a) const{
+    return lat == a.lat && lng == a.lng;
+  }
+  inline Pos operator-(const Pos &a) const{
+    return Pos(lat-a.lat, lng-a.lng);
+  }
+  inline constexpr double dot(const Pos &a) const{
+    return lat*a.lat + lng*a.lng;
+  }
+  inline constexpr double cross(const Pos &a) const{
+    return lat*a.lng - lng*a.lat;
+  }
+  inline constexpr double abs() const{
+    return sqrt(lat*lat + lng*lng);
+  }
+  inline constexpr double arg_cos(const Pos &a) const{
+    return (dot(a) / (abs() * a.abs()));
+  }
+  inline constexpr double arg() const{
+    return atan2(lng, lat);
+  }
+};
+
+using Path = std::vector<Pos>;
+
+inline uint64_t hash_mix(uint64_t x){
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+// -0.0 と 0.0 は同じ値とする(Pos::operator== と同じ)
+inline uint64_t hash_pos(const Pos &p){
+  uint64_t a, b;
+  const double lat = p.lat + 0.0, lng = p.lng + 0.0;
+  std::memcpy(&a, &lat, sizeof(a));
+  std::memcpy(&b, &lng, sizeof(b));
+  return hash_mix(a ^ hash_mix(b));
+}
+
+// 座標を頂点番号に対応させるopen addressingのハッシュ表
+// tolerance > 0 のときは,すでに登録された点から tolerance 以内(緯度と経度の差がどちらも tolerance 以下)の点をその頂点とする
+// 点を tolerance の大きさのセルに分け,自分のセルと周りの8つのセルに登録された点だけを調べる
+// 近い点が複数あるときは先に登録された点を選ぶので,結果は登録する順に依存する(連鎖的にはまとめない)
+struct PosIndex {
+  explicit PosIndex(const double tolerance = 0) : tolerance(tolerance), count(0), keys(16), values(16, -1){}
+
+  // posの頂点番号を返す,なければidとして登録する
+  int find_or_insert(const Pos &pos, const int id){
+    if(tolerance > 0) return weld(pos, id);
+    if((count + 1) * 2 > values.size()) rehash(values.size() * 2);
+    size_t slot = hash_pos(pos) & (values.size() - 1);
+    while(values[slot] != -1){
+      if(keys[slot] == pos) return values[slot];
+      slot = (slot + 1) & (values.size() - 1);
+    }
+    keys[slot] = pos;
+    values[slot] = id;
+    count++;
+    return id;
+  }
+
+private:
+  double tolerance;
+  size_t count;
+  std::vector<Pos> keys;
+  std::vector<int> values;
+  std::unordered_map<uint64_t, std::vector<std::pair<Pos, int>>> cells; // tolerance > 0 のときのセルごとの点と頂点番号
+
+  static uint64_t cell_key(const int64_t x, const int64_t y){
+    return ((uint64_t)x << 32) ^ (uint32_t)y;
+  }
+  int weld(const Pos &pos, const int id){
+    const int64_t cx = std::floor(pos.lat / tolerance), cy = std::floor(pos.lng / tolerance);
+    int best = -1;
+    for(int64_t x = cx - 1; x <= cx + 1; x++){
+      for(int64_t y = cy - 1; y <= cy + 1; y++){
+        const auto itr = cells.find(cell_key(x, y));
+        if(itr == cells.end()) continue;
+        for(const auto &[p, v] : itr->second){
+          if(std::abs(p.lat - pos.lat) > tolerance || std::abs(p.lng - pos.lng) > tolerance) continue;
+          if(best == -1 || v < best) best = v;
+        }
+      }
+    }
+    if(best != -1) return best;
+    cells[cell_key(cx, cy)].emplace_back(pos, id);
+    return id;
+  }
+  void rehash(const size_t cap){
+    std::vector<Pos> old_keys(cap);
+    std::vector<int> old_values(cap, -1);
+    std::swap(keys, old_keys);
+    std::swap(values, old_values);
+    for(size_t i = 0; i < old_values.size(); i++){
+      if(old_values[i] == -1) continue;
+      size_t slot = hash_pos(old_keys[i]) & (cap - 1);
+      while(values[slot] != -1) slot = (slot + 1) & (cap - 1);
+      keys[slot] = old_keys[i];
+      values[slot] = old_values[i];
+    }
+  }
+};
+
+struct Station {
+  std::vector<Path> geometry;
+  int station_code, railway_id;
+  std::string railway_name, railway_company, station_name;
+  Station(std::vector<Path> g, const int s, const int r, std::string rn, std::string rc, std::string sn) :
+    geometry(std::move(g)), station_code(s), railway_id(r), railway_name(std::move(rn)), railway_company(std::move(rc)), station_name(std::move(sn)){}
+};
+
+enum class RailwayType {
+  LinearList,
+  Circle,
+  WithLoop,
+  WithBranches,
+  None,
+};
+
+// stationは stations の要素を指す
+struct NextStaInfo {
+  const Station *station;
+  int index;
+  std::vector<int> left, right;
+  NextStaInfo(const Station *sta, const int idx, std::vector<int> dir1, std::vector<int> dir2) :
+    station(sta), index(idx), left(std::move(dir1)), right(std::move(dir2)){}
+
+  std::vector<int> next_list() const{
+    std::vector<int> temp = left;
+    temp.insert(temp.end(), right.begin(), right.end());
+    return temp;
+  }
+  inline int size() const{
+    return left.size() + right.size();
+  }
+};
+
+// pathの線分を一様なグリッドに登録して,ある点の近くを通る線分を探す
+// 線分はepsだけ広げた線分が通るセルにだけ登録する
+struct SegmentGrid {
+  SegmentGrid(const std::vector<Path> &paths, const double eps) : eps(eps){
+    // セルの大きさは線分の平均的な長さにする
+    double tot = 0;
+    int seg_num = 0;
+    for(const auto &path : paths){
+      for(int k = 0; k < (int)path.size()-1; k++){
+        tot += std::max(std::abs(path[k+1].lat - path[k].lat), std::abs(path[k+1].lng - path[k].lng));
+        seg_num++;
+      }
+    }
+    cell_size = std::max(seg_num ? tot / seg_num : 1.0, 1e-5);
+    for(int i = 0; i < (int)paths.size(); i++) insert_path(paths, i);
+  }
+
+  void insert_path(const std::vector<Path> &paths, const int path_idx){
+    const auto &path = paths[path_idx];
+    for(int k = 0; k < (int)path.size()-1; k++){
+      insert(path_idx, k, path[k], path[k+1]);
+    }
+  }
+
+  // posの近くを通る可能性のある線分の(pathの番号,線分の番号)を昇順に返す
+  // pathが短くなって存在しなくなった線分は除く
+  std::vector<std::pair<int, int>> query(const std::vector<Path> &paths, const Pos &pos) const{
+    std::vector<std::pair<int, int>> res;
+    const auto itr = cells.find(key(cell_index(pos.lat), cell_index(pos.lng)));
+    if(itr == cells.end()) return res;
+    for(const auto &seg : itr->second){
+      if(seg.second < (int)paths[seg.first].size()-1) res.push_back(seg);
+    }
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+  }
+
+private:
+  double eps, cell_size;
+  std::unordered_map<int64_t, std::vector<std::pair<int, int>>> cells;
+
+  int64_t cell_index(const double x) const{
+    return (int64_t)std::floor(x / cell_size);
+  }
+  static int64_t key(const int64_t x, const int64_t y){
+    // 負の値の左シフトは未定義なので符号なしで計算する
+    return (int64_t)(((uint64_t)x << 32) ^ (uint32_t)y);
+  }
+  void insert(const int path_idx, const int seg_idx, const Pos &a, const Pos &b){
+    // 緯度方向の列ごとに,列(をepsだけ広げた範囲)に入る部分の経度の範囲を求める
+    // 長い斜めの線分でも登録するセルの数は線分の長さに比例する
+    const int64_t x1 = cell_index(std::min(a.lat, b.lat) - eps), x2 = cell_index(std::max(a.lat, b.lat) + eps);
+    const double d = b.lat - a.lat;
+    for(int64_t x = x1; x <= x2; x++){
+      double t1 = 0, t2 = 1;
+      if(d != 0){
+        t1 = (x * cell_size - eps - a.lat) / d;
+        t2 = ((x + 1) * cell_size + eps - a.lat) / d;
+        if(t1 > t2) std::swap(t1, t2);
+        t1 = std::max(t1, 0.0);
+        t2 = std::min(t2, 1.0);
+        if(t1 > t2) continue;
+      }
+      const double lng1 = a.lng + (b.lng - a.lng) * t1, lng2 = a.lng + (b.lng - a.lng) * t2;
+      const int64_t y1 = cell_index(std::min(lng1, lng2) - eps), y2 = cell_index(std::max(lng1, lng2) + eps);
+      for(int64_t y = y1; y <= y2; y++){
+        cells[key(x, y)].emplace_back(path_idx, seg_idx);
+      }
+    }
+  }
+};
+
+// 頂点の最近傍探索用の静的なkd-tree
+// Pos::dist が同じ頂点が複数あるときは番号の最も小さい頂点を返す(線形探索と同じ結果になる)
+struct KDTree {
+  explicit KDTree(const std::vector<Pos> &points) : points(points), ids(points.size()), split_axis(points.size()){
+    for(int i = 0; i < (int)ids.size(); i++) ids[i] = i;
+    build(0, ids.size());
+  }
+
+  int nearest(const Pos &pos) const{
+    double min_dist = 1e9;
+    int min_idx = -1;
+    search(0, ids.size(), pos, min_dist, min_idx);
+    return min_idx;
+  }
+
+private:
+  const std::vector<Pos> &points;
+  std::vector<int> ids;
+  std::vector<char> split_axis; // 0:lat,1:lng
+
+  static double coord(const Pos &p, const int axis){
+    return axis ? p.lng : p.lat;
+  }
+
+  void build(const int l, const int r){
+    if(r - l <= 1) return;
+    double min_lat = 1e9, max_lat = -1e9, min_lng = 1e9, max_lng = -1e9;
+    for(int i = l; i < r; i++){
+      const Pos &p = points[ids[i]];
+      min_lat = std::min(min_lat, p.lat); max_lat = std::max(max_lat, p.lat);
+      min_lng = std::min(min_lng, p.lng); max_lng = std::max(max_lng, p.lng);
+    }
+    const int axis = max_lng - min_lng > max_lat - min_lat;
+    const int mid = (l + r) / 2;
+    std::nth_element(ids.begin() + l, ids.begin() + mid, ids.begin() + r, [&](const int a, const int b){
+      return coord(points[a], axis) < coord(points[b], axis);
+    });
+    split_axis[mid] = axis;
+    build(l, mid);
+    build(mid + 1, r);
+  }
+
+  void search(const int l, const int r, const Pos &pos, double &min_dist, int &min_idx) const{
+    if(l >= r) return;
+    const int mid = (l + r) / 2;
+    const int idx = ids[mid];
+    const double d = pos.dist(points[idx]);
+    if(min_dist > d || (min_dist == d && idx < min_idx)){
+      min_dist = d;
+      min_idx = idx;
+    }
+    if(r - l == 1) return;
+    const double diff = coord(pos, split_axis[mid]) - coord(points[idx], split_axis[mid]);
+    // 分割面までの距離がmin_distより大きければ反対側に同じ距離以下の頂点はない
+    if(diff < 0){
+      search(l, mid, pos, min_dist, min_idx);
+      if(-diff <= min_dist) search(mid + 1, r, pos, min_dist, min_idx);
+    }else{
+      search(mid + 1, r, pos, min_dist, min_idx);
+      if(diff <= min_dist) search(l, mid, pos, min_dist, min_idx);
+    }
+  }
+};
+
+// 線路のグラフの隣接リストを1つの配列に詰めて持つ(CSR)
+// 頂点の追加は末尾に行い,辺の削除は墓標(-1)を置いてcompact()でまとめて詰める
+struct RailGraph {
+  // 辺を追加した順に各頂点の隣接リストを並べる
+  RailGraph(const int n, const std::vector<std::pair<int, int>> &edges) : first(n + 1), last(n), deg(n){
+    for(const auto &e : edges){
+      deg[e.first]++;
+      deg[e.second]++;
+    }
+    for(int v = 0; v < n; v++) first[v+1] = first[v] + deg[v];
+    adj.resize(first[n]);
+    for(int v = 0; v < n; v++) last[v] = first[v];
+    for(const auto &e : edges){
+      adj[last[e.first]++] = e.second;
+      adj[last[e.second]++] = e.first;
+    }
+    first.pop_back();
+  }
+
+  int size() const{
+    return first.size();
+  }
+  int degree(const int v) const{
+    return deg[v];
+  }
+  // 墓標のない頂点のk番目の隣接頂点
+  int at(const int v, const int k) const{
+    return adj[first[v] + k];
+  }
+  // 墓標を除いた最初の隣接頂点
+  int front(const int v) const{
+    for(int k = first[v]; k < last[v]; k++) if(adj[k] >= 0) return adj[k];
+    return -1;
+  }
+  // compact() の後に使う
+  const int *begin(const int v) const{
+    return adj.data() + first[v];
+  }
+  const int *end(const int v) const{
+    return adj.data() + last[v];
+  }
+
+  int add_vertex(const std::vector<int> &nexts){
+    first.push_back(adj.size());
+    adj.insert(adj.end(), nexts.begin(), nexts.end());
+    last.push_back(adj.size());
+    deg.push_back(nexts.size());
+    return size() - 1;
+  }
+  void replace(const int v, const int from, const int to){
+    for(int k = first[v]; k < last[v]; k++) if(adj[k] == from) adj[k] = to;
+  }
+  void pop_back(const int v){
+    last[v]--;
+    deg[v]--;
+  }
+  void clear(const int v){
+    for(int k = first[v]; k < last[v]; k++) adj[k] = -1;
+    deg[v] = 0;
+  }
+  void erase(const int v, const int x){
+    for(int k = first[v]; k < last[v]; k++){
+      if(adj[k] != x) continue;
+      adj[k] = -1;
+      deg[v]--;
+    }
+  }
+  // 墓標と使われていない領域を取り除いて詰め直す
+  void compact(){
+    int pos = 0;
+    for(int v = 0; v < size(); v++){
+      const int b = first[v], e = last[v];
+      first[v] = pos;
+      for(int k = b; k < e; k++) if(adj[k] >= 0) adj[pos++] = adj[k];
+      last[v] = pos;
+    }
+    adj.resize(pos);
+    adj.shrink_to_fit();
+  }
+
+private:
+  std::vector<int> first, last, deg, adj;
+};
+
+// 駅ごとのBFSの作業領域
+// 頂点ごとに最後に訪れた世代を持つことで,探索のたびに全体を初期化しなくてよいようにする
+struct BfsScratch {
+  std::vector<int> que;
+
+  explicit BfsScratch(const int n) : epoch(0), stamp(n, 0), prev_pos(n){}
+
+  void reset(){
+    epoch++;
+    que.clear();
+  }
+  bool visited(const int x) const{
+    return stamp[x] == epoch;
+  }
+  void visit(const int x, const int prev){
+    stamp[x] = epoch;
+    prev_pos[x] = prev;
+  }
+  // 訪れていない頂点,探索の始点は-1
+  int prev(const int x) const{
+    return x >= 0 && visited(x) ? prev_pos[x] : -1;
+  }
+
+private:
+  int epoch;
+  std::vector<int> stamp, prev_pos;
+};
+
+// --stats のときに路線ごとに集める時間(ms)と数
+struct RailwayStats {
+  double split_ms = 0;  // データに記述されていない交点でpathを分ける
+  double snap_ms = 0;   // 座標をまとめて頂点にし,グラフを作る(X状のpathの分離を含む)
+  double locate_ms = 0; // 駅のある頂点を探し,先端まで駅のないpathを削除する
+  double bfs_ms = 0;    // 駅ごとのBFSと隣駅の方向の計算
+  double orient_ms = 0; // 連結成分ごとに left/right の向きを揃える
+  double output_ms = 0; // 結果の書き出し(calc が入れる)
+  int station_num = 0, path_num = 0, split_num = 0, vertex_num = 0, edge_num = 0;
+  long long bfs_expanded_nodes = 0;
+
+  static constexpr std::pair<const char*, double RailwayStats::*> PHASES[] = {
+    { "split", &RailwayStats::split_ms },
+    { "snap", &RailwayStats::snap_ms },
+    { "locate", &RailwayStats::locate_ms },
+    { "bfs", &RailwayStats::bfs_ms },
+    { "orient", &RailwayStats::orient_ms },
+    { "output", &RailwayStats::output_ms },
+  };
+  double total_ms() const{
+    double total = 0;
+    for(const auto &phase : PHASES) total += this->*phase.second;
+    return total;
+  }
+};
+
+// 前回からの時間を RailwayStats の段階に足す
+// stats が nullptr のときは時刻を取らない
+struct StatsLap {
+  explicit StatsLap(RailwayStats *stats) : stats(stats){
+    if(stats) last = StatsClock::now();
+  }
+  void operator()(double RailwayStats::*phase){
+    if(!stats) return;
+    const auto now = StatsClock::now();
+    stats->*phase += elapsed_ms(last, now);
+    last = now;
+  }
+
+private:
+  RailwayStats *stats;
+  StatsClock::time_point last;
+};
+
+// BFSで取り出した頂点の数を返す
+// stats が nullptr でなければ段階ごとの時間とグラフの大きさを入れる
+inline long long search_next_station(const std::vector<const Station*> &railway_stations, std::vector<NextStaInfo> &next_station_data, std::vector<Path> &paths, const double snap_tolerance, RailwayStats *stats = nullptr){
+  StatsLap lap(stats);
+  const int path_num = paths.size();
+  // データに記述されていない交点を探す
+  // 端点の近くを通る線分だけをグリッドから取り出して,pathの番号の小さい順に調べる
+  SegmentGrid grid(paths, 1e-6);
+  for(int i = 0; i < path_num; i++){
+    for(const Pos &pos : Path{ paths[i][0], paths[i].back() }){
+      const auto cands = grid.query(paths, pos);
+      bool through = false;
+      for(int c = 0; c < (int)cands.size() && !through; ){
+        const int j = cands[c].first;
+        int c_end = c;
+        while(c_end < (int)cands.size() && cands[c_end].first == j) c_end++;
+        if(i == j){
+          c = c_end;
+          continue;
+        }
+        const auto &path = paths[j];
+        for(const Pos &p : path) if(p == pos){
+          through = true;
+          break;
+        }
+        if(through) break;
+        for(; c < c_end; c++){
+          const int k = cands[c].second;
+          if((path[k+1]-path[k]).dot(pos-path[k]) < 0) continue;
+          if((path[k]-path[k+1]).dot(pos-path[k+1]) < 0) continue;
+          const double d = std::abs((path[k+1]-path[k]).cross(pos-path[k]) / (path[k+1]-path[k]).abs());
+          if(d < 1e-6){
+            auto &sep_path = paths[j];
+            Path back_path(sep_path.begin() + k, sep_path.end());
+            back_path[0] = pos;
+            sep_path.erase(sep_path.begin() + k+1, sep_path.end());
+            sep_path.push_back(pos);
+            // pathsの再確保でsep_pathが無効になるので最後に追加する
+            paths.push_back(std::move(back_path));
+            // 分割されたpathの線分もこれ以降の探索の対象にする
+            grid.insert_path(paths, paths.size() - 1);
+            if(stats) stats->split_num++;
+            through = true;
+            break;
+          }
+        }
+        c = c_end;
+      }
+    }
+  }
+
+  lap(&RailwayStats::split_ms);
+
+  // build graph
+  std::vector<Pos> pos_data;
+  PosIndex index(snap_tolerance);
+  std::vector<std::pair<int, int>> edges;
+  std::vector<int> path_kinds_num;
+  for(const auto &path : paths){
+    int prev_idx = -1;
+    for(const Pos &p : path){
+      const int idx = index.find_or_insert(p, pos_data.size());
+      if(idx == (int)pos_data.size()){
+        pos_data.push_back(p);
+        path_kinds_num.push_back(0);
+      }
+      // まとめて同じ頂点になった連続する点は1つの点として扱う(自己ループを作らない)
+      // snap しないときは従来どおり,座標が重複した点もそのまま辺と数に含める
+      if(snap_tolerance > 0 && idx == prev_idx) continue;
+      if(prev_idx != -1) edges.emplace_back(idx, prev_idx);
+      path_kinds_num[idx]++;
+      prev_idx = idx;
+    }
+  }
+  RailGraph root(pos_data.size(), edges);
+  std::vector<std::pair<int, int>>().swap(edges);
+  // 特定のX状のpathを分離する
+  for(int i = 0; i < root.size(); i++){
+    if(root.degree(i) != 4) continue;
+    if(path_kinds_num[i] >= 4) continue;
+    // 分離
+    const int last = root.size();
+    root.replace(root.at(i, 2), i, last);
+    root.replace(root.at(i, 3), i, last);
+    root.add_vertex({ root.at(i, 2), root.at(i, 3) });
+    root.pop_back(i); root.pop_back(i);
+    pos_data.push_back(pos_data[i]);
+  }
+  lap(&RailwayStats::snap_ms);
+
+  const int station_num = railway_stations.size();
+  std::vector<std::vector<int>> station_indices(station_num);
+  const KDTree tree(pos_data);
+  for(int i = 0; i < station_num; i++){
+    for(const auto &path : railway_stations[i]->geometry){
+      const Pos middle = path[path.size() / 2];
+      station_indices[i].push_back(tree.nearest(middle));
+    }
+  }
+
+  // 駅がある頂点をメモ
+  std::vector<int> has_station(root.size(), -1);
+  for(int i = 0; i < station_num; i++){
+    for(const int idx : station_indices[i]){
+      has_station[idx] = i;
+    }
+  }
+
+  // 先端まで何もないpathを削除する,スイッチバックがある程度解決される
+  for(int i = 0; i < root.size(); i++){
+    int p = i;
+    while(root.degree(p) == 1 && has_station[p] < 0){
+      const int nxt = root.front(p);
+      root.clear(p);
+      root.erase(nxt, p);
+      p = nxt;
+    }
+  }
+  root.compact();
+  lap(&RailwayStats::locate_ms);
+
+  // ひとつずつ探索していく
+  // 作業領域は駅ごとに確保し直さず,訪れた頂点の数に比例する時間で探索する
+  BfsScratch bfs(root.size());
+  std::vector<int> next_stations;
+  long long expanded_nodes = 0;
+  for(int i = 0; i < station_num; i++){
+    next_stations.clear();
+    bfs.reset();
+    for(const int idx : station_indices[i]){
+      bfs.visit(idx, -1);
+      bfs.que.push_back(idx);
+    }
+    for(size_t head = 0; head < bfs.que.size(); head++){
+      const int pos = bfs.que[head];
+      const int prev_pos = bfs.prev(pos);
+      expanded_nodes++;
+      for(const int *itr = root.begin(pos); itr != root.end(pos); itr++){
+        const int x = *itr;
+        if(bfs.visited(x)) continue;
+        if(prev_pos < 0 || root.degree(pos) == 2 || ((pos_data[x]-pos_data[pos]).arg_cos(pos_data[prev_pos]-pos_data[pos])) < 0.33){
+          bfs.visit(x, pos);
+          if(has_station[x] < 0 || has_station[x] == i) bfs.que.push_back(x);
+          else next_stations.push_back(x);
+        }
+      }
+    }
+    // next stationsの方向を計算
+    const int next_num = next_stations.size();
+    std::vector<double> args(next_num);
+    for(int j = 0; j < next_num; j++){
+      int p = next_stations[j];
+      while(bfs.prev(bfs.prev(p)) != -1) p = bfs.prev(p);
+      args[j] = (pos_data[p] - pos_data[bfs.prev(p)]).arg();
+    }
+    std::vector<int> dir1_next_stations, dir2_next_stations;
+    if(next_num){
+      for(int j = 0; j < next_num; j++){
+        if(abs(args[0] - args[j]) < 0.1 || abs(PI*2 - abs(args[0] - args[j])) < 0.1){
+          dir1_next_stations.push_back(has_station[next_stations[j]]);
+        }else{
+          dir2_next_stations.push_back(has_station[next_stations[j]]);
+        }
+      }
+      std::sort(dir1_next_stations.begin(), dir1_next_stations.end());
+      dir1_next_stations.erase(std::unique(dir1_next_stations.begin(), dir1_next_stations.end()), dir1_next_stations.end());
+      std::sort(dir2_next_stations.begin(), dir2_next_stations.end());
+      dir2_next_stations.erase(std::unique(dir2_next_stations.begin(), dir2_next_stations.end()), dir2_next_stations.end());
+    }
+    next_station_data.emplace_back(railway_stations[i], i, std::move(dir1_next_stations), std::move(dir2_next_stations));
+  }
+  lap(&RailwayStats::bfs_ms);
+  if(stats){
+    stats->station_num = station_num;
+    stats->path_num = paths.size();
+    stats->vertex_num = root.size();
+    long long degree_sum = 0;
+    for(int v = 0; v < root.size(); v++) degree_sum += root.degree(v);
+    stats->edge_num = degree_sum / 2;
+    stats->bfs_expanded_nodes = expanded_nodes;
+  }
+  return expanded_nodes;
+}
+
+// 点をまとめたときは,駅が重なったりpathが縮んだりして,aの隣にbがあってもbの隣にaがないことがある
+// 向きを決める処理は隣駅の関係が対称であることを前提にしているので,bの隣駅のうちaの方向に近い側にaを足す
+inline void make_next_stations_symmetric(std::vector<NextStaInfo> &next_station_data){
+  auto center = [&](const int i){
+    const Path &path = next_station_data[i].station->geometry[0];
+    return path[path.size() / 2];
+  };
+  auto contains = [](const std::vector<int> &list, const int x){
+    return std::find(list.begin(), list.end(), x) != list.end();
+  };
+  std::vector<std::pair<int, int>> missing; // (b, a): bの隣駅にaを足す
+  for(const auto &data : next_station_data){
+    for(const int b : data.next_list()){
+      if(b == data.index) continue;
+      if(!contains(next_station_data[b].left, data.index) && !contains(next_station_data[b].right, data.index)){
+        missing.emplace_back(b, data.index);
+      }
+    }
+  }
+  std::sort(missing.begin(), missing.end());
+  missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+  for(const auto &[b, a] : missing){
+    const Pos dir = center(a) - center(b);
+    // 各側の隣駅の方向とのcosの最大値,空なら0
+    auto closeness = [&](const std::vector<int> &list){
+      double res = list.empty() ? 0 : -1;
+      for(const int x : list){
+        const Pos other = center(x) - center(b);
+        if(dir.abs() > 0 && other.abs() > 0) res = std::max(res, dir.arg_cos(other));
+      }
+      return res;
+    };
+    auto &data = next_station_data[b];
+    if(closeness(data.left) >= closeness(data.right)) data.left.push_back(a);
+    else data.right.push_back(a);
+  }
+}
+
+inline std::vector<std::vector<NextStaInfo>> separate_to_connected_graph(std::vector<NextStaInfo> next_station_data){
+  const int station_num = next_station_data.size();
+  UnionFind tree(station_num);
+  for(const auto &data : next_station_data){
+    for(const auto &sta : data.next_list()){
+      tree.unite(data.index, sta);
+    }
+  }
+  if(tree.size(0) == station_num){
+    return { std::move(next_station_data) };
+  }
+
+  std::map<int, std::vector<NextStaInfo>> group;
+  for(auto &data : next_station_data){
+    group[tree.root(data.index)].push_back(std::move(data));
+  }
+  std::vector<std::vector<NextStaInfo>> next_station_graph_data;
+  std::vector<int> indices(station_num);
+  for(auto &elem : group){
+    int count = 0;
+    for(const auto &data : elem.second){
+      indices[data.index] = count;
+      count++;
+    }
+    for(auto &info : elem.second){
+      info.index = indices[info.index];
+      for(int &x : info.left) x = indices[x];
+      for(int &x : info.right) x = indices[x];
+    }
+    next_station_graph_data.push_back(std::move(elem.second));
+  }
+  return next_station_graph_data;
+}
+
+inline void calc_linear_list_graph(std::vector<NextStaInfo> &graph){
+  const int station_num = graph.size();
+  std::vector<int> start_cands;
+  for(int i = 0; i < station_num; i++){
+    if((int)graph[i].size() != 1) continue;
+    start_cands.emplace_back(i);
+  }
+  NEXT_STATION_CHECK(!start_cands.empty());
+  int cur = start_cands[0];
+  for(const int idx : start_cands){
+    if(graph[cur].station->geometry[0][0].lng > graph[idx].station->geometry[0][0].lng){
+      cur = idx;
+    }
+  }
+  if((int)start_cands.size() == 2){
+    const auto pos0 = graph[start_cands[0]].station->geometry[0][0];
+    const auto pos1 = graph[start_cands[1]].station->geometry[0][0];
+    if(std::abs(pos0.lat - pos1.lat) < std::abs(pos0.lng - pos1.lng)){
+      if(pos0.lng < pos1.lng) cur = start_cands[0];
+      else cur = start_cands[1];
+    }else{
+      if(pos0.lat < pos1.lat) cur = start_cands[0];
+      else cur = start_cands[1];
+    }
+  }
+  int prev = -1;
+  while(prev == -1 || (int)graph[cur].size() == 2){
+    for(const int x : graph[cur].next_list()){
+      if(x == prev) continue;
+      if(prev != -1) graph[cur].left = { prev };
+      else graph[cur].left = {};
+      graph[cur].right = { x };
+      prev = cur;
+      cur = x;
+      break;
+    }
+  }
+  graph[cur].left = { prev };
+  graph[cur].right = {};
+}
+
+inline void calc_circle_graph(std::vector<NextStaInfo> &graph){
+  int cur = graph[0].next_list()[0], prev = 0;
+  graph[0].right = { cur };
+  while(cur != 0){
+    for(const int x : graph[cur].next_list()){
+      if(x == prev) continue;
+      graph[cur].left = { prev };
+      graph[cur].right = { x };
+      prev = cur;
+      cur = x;
+      break;
+    }
+  }
+  graph[0].left = { prev };
+}
+
+inline void calc_with_loop_graph(std::vector<NextStaInfo> &graph){
+  const int station_num = graph.size();
+  int st = -1;
+  for(int i = 0; i < station_num; i++){
+    if(graph[i].size() == 1){
+      st = i;
+      break;
+    }
+  }
+  NEXT_STATION_CHECK(st != -1);
+  int cur = st, prev = -1;
+  bool visited_branch = false;
+  while(true){
+    if(graph[cur].size() <= 2){
+      for(const int x : graph[cur].next_list()){
+        if(x == prev) continue;
+        if(prev != -1) graph[cur].left = { prev };
+        else graph[cur].left = {};
+        graph[cur].right = { x };
+        prev = cur;
+        cur = x;
+        break;
+      }
+    }else{
+      if(visited_branch) break;
+      int a = -1, b = -1;
+      for(const int x : graph[cur].next_list()){
+        if(x == prev) continue;
+        if(a < 0) a = x;
+        else b = x;
+      }
+      if(graph[a].station->geometry[0][0] < graph[b].station->geometry[0][0]) std::swap(a, b);
+      visited_branch = true;
+      NEXT_STATION_CHECK(prev != -1);
+      graph[cur].left = { prev };
+      graph[cur].right = { a, b };
+      prev = cur;
+      cur = a;
+    }
+  }
+}
+
+// graph[0] から left/right の向きを辿って DAG を作り、トポロジカル順を返す
+// 閉路があれば返す順序は頂点数より短くなる
+inline std::vector<int> create_branches_dag(const std::vector<NextStaInfo> &graph, std::vector<std::vector<int>> &root){
+  const int station_num = graph.size();
+  root.assign(station_num, {});
+  {
+    std::queue<std::tuple<int, int, int>> que;
+    std::vector<int> used(station_num);
+    for(const int x : graph[0].right){
+      root[0].push_back(x);
+      que.push({ x, 0, 0 });
+    }
+    for(const int x : graph[0].left){
+      que.push({ x, 0, 1 });
+    }
+    used[0] = 1;
+    while(!que.empty()){
+      int pos, prev, dir;
+      std::tie(pos, prev, dir) = que.front();
+      que.pop();
+      if(used[pos]) continue;
+      used[pos] = 1;
+      int prev_dir = 0; // 0:left,1:right
+      for(const int x : graph[pos].right){
+        if(x == prev){
+          prev_dir = 1;
+          break;
+        }
+      }
+      // prevから頂点が向けられている
+      if(!dir){
+        for(const int x : (prev_dir ? graph[pos].right : graph[pos].left)){
+          if(x == prev) continue;
+          que.push({ x, pos, 1 });
+        }
+        for(const int x : (prev_dir ? graph[pos].left : graph[pos].right)){
+          root[pos].push_back(x);
+          que.push({ x, pos, 0 });
+        }
+      }else{
+        for(const int x : (prev_dir ? graph[pos].right : graph[pos].left)){
+          root[pos].push_back(x);
+          if(x == prev) continue;
+          que.push({ x, pos, 0 });
+        }
+        for(const int x : (prev_dir ? graph[pos].left : graph[pos].right)){
+          que.push({ x, pos, 1 });
+        }
+      }
+    }
+  }
+
+  // tp-sort
+  std::vector<int> dag(station_num);
+  std::vector<int> ord;
+  std::queue<int> que;
+  for(int i = 0; i < station_num; i++){
+    for(const int x : root[i]) dag[x]++;
+  }
+  for(int i = 0; i < station_num; i++){
+    if(!dag[i]) que.push(i);
+  }
+  while(!que.empty()){
+    const int pos = que.front();
+    que.pop();
+    ord.push_back(pos);
+    for(const int x : root[pos]){
+      if(!--dag[x]) que.push(x);
+    }
+  }
+  return ord;
+}
+
+// 向きを直しても閉路が残るとき(点をまとめて駅が重なったときなど)のトポロジカル順
+// 入次数0の頂点がなくなったら,残りで入次数の最も小さい頂点(同じなら番号の小さい頂点)へ入る辺を逆向きにして進める
+inline std::vector<int> break_branches_dag_cycles(std::vector<std::vector<int>> &root){
+  const int station_num = root.size();
+  std::vector<std::vector<int>> root_in(station_num);
+  std::vector<int> dag(station_num), placed(station_num);
+  for(int i = 0; i < station_num; i++){
+    for(const int x : root[i]){
+      root_in[x].push_back(i);
+      dag[x]++;
+    }
+  }
+  std::vector<int> ord;
+  std::queue<int> que;
+  for(int i = 0; i < station_num; i++){
+    if(!dag[i]) que.push(i);
+  }
+  while((int)ord.size() < station_num){
+    if(que.empty()){
+      int v = -1;
+      for(int i = 0; i < station_num; i++){
+        if(!placed[i] && (v < 0 || dag[i] < dag[v])) v = i;
+      }
+      for(const int u : root_in[v]){
+        if(placed[u]) continue;
+        auto &list = root[u];
+        const auto itr = std::find(list.begin(), list.end(), v);
+        if(itr == list.end()) continue;
+        list.erase(itr);
+        root[v].push_back(u);
+        dag[u]++;
+      }
+      dag[v] = 0;
+      que.push(v);
+    }
+    const int pos = que.front();
+    que.pop();
+    placed[pos] = 1;
+    ord.push_back(pos);
+    for(const int x : root[pos]){
+      if(!--dag[x]) que.push(x);
+    }
+  }
+  return ord;
+}
+
+// 両端とも訪問済みの辺を除いた DAG の最長路を、全頂点を訪れるまで1本ずつ取り出し、取り出した路の辺を返す
+// 最長路は終点が最も長いもの(同じなら番号の小さい終点)で、路の各頂点の前はトポロジカル順で最も前の頂点とする
+// 路を取り出すたびに DP をやり直す代わりに、辺が除かれた頂点と、dp の値が変わった頂点の後ろだけをトポロジカル順に計算し直す
+// dp は除かれた辺の先でしか変わらず、各頂点の値は減るだけなので、計算量は O((V + E + 値の変わった回数 * 次数) log V)
+// 木に近い路線の DAG では各頂点の値が変わるのは数回なので、ほぼ線形になる
+inline std::vector<std::vector<int>> peel_branches_dag(const std::vector<std::vector<int>> &root, const std::vector<int> &ord){
+  const int station_num = root.size();
+  std::vector<std::vector<int>> aligned_root(station_num), root_in(station_num);
+  std::vector<int> order_idx(station_num);
+  for(int i = 0; i < station_num; i++){
+    order_idx[ord[i]] = i;
+    for(const int x : root[i]) root_in[x].push_back(i);
+  }
+  std::vector<int> visited(station_num);
+  const auto alive = [&](const int a, const int b){ return !(visited[a] && visited[b]); };
+
+  std::vector<int> dp(station_num), prev(station_num, -1);
+  for(const int i : ord){
+    for(const int x : root[i]){
+      if(dp[x] < dp[i] + 1){
+        dp[x] = dp[i] + 1;
+        prev[x] = i;
+      }
+    }
+  }
+  // (dp, -終点) の最大ヒープ,dp が変わったら入れ直し,古くなった要素は取り出すときに捨てる
+  std::priority_queue<std::pair<int, int>> longest;
+  for(int i = 0; i < station_num; i++){
+    if(dp[i] >= 1) longest.push({ dp[i], -i });
+  }
+
+  // 計算し直す頂点をトポロジカル順に取り出す
+  std::priority_queue<int, std::vector<int>, std::greater<int>> pending;
+  std::vector<int> is_pending(station_num);
+  const auto schedule = [&](const int x){
+    if(is_pending[x]) return;
+    is_pending[x] = 1;
+    pending.push(order_idx[x]);
+  };
+  // 残っている入る辺から dp と prev を求め直す,dp が変わったら後ろの頂点も計算し直す
+  const auto recompute = [&](const int x){
+    int best = 0, best_prev = -1;
+    for(const int u : root_in[x]){
+      if(!alive(u, x)) continue;
+      if(dp[u] + 1 > best || (dp[u] + 1 == best && order_idx[u] < order_idx[best_prev])){
+        best = dp[u] + 1;
+        best_prev = u;
+      }
+    }
+    prev[x] = best_prev;
+    if(best == dp[x]) return;
+    dp[x] = best;
+    if(dp[x] >= 1) longest.push({ dp[x], -x });
+    for(const int y : root[x]){
+      if(alive(x, y)) schedule(y);
+    }
+  };
+
+  int unvisited = station_num;
+  std::vector<int> newly;
+  while(unvisited){
+    while(!longest.empty() && dp[-longest.top().second] != longest.top().first) longest.pop();
+    NEXT_STATION_CHECK(!longest.empty());
+    int cur = -longest.top().second;
+    newly.clear();
+    if(!visited[cur]) newly.push_back(cur);
+    visited[cur] = 1;
+    while(prev[cur] != -1){
+      const int pre = prev[cur];
+      aligned_root[pre].push_back(cur);
+      if(!visited[pre]) newly.push_back(pre);
+      visited[pre] = 1;
+      cur = pre;
+    }
+    unvisited -= newly.size();
+    // 新しく訪れた頂点と訪問済みの頂点の間の辺が除かれる
+    for(const int v : newly){
+      for(const int x : root[v]){
+        if(visited[x]) schedule(x);
+      }
+      for(const int u : root_in[v]){
+        if(visited[u]) schedule(v);
+      }
+    }
+    while(!pending.empty()){
+      const int x = ord[pending.top()];
+      pending.pop();
+      is_pending[x] = 0;
+      recompute(x);
+    }
+  }
+  return aligned_root;
+}
+
+inline void calc_with_branches_graph(std::vector<NextStaInfo> &graph){
+  const int station_num = graph.size();
+  std::vector<std::vector<int>> root;
+  std::vector<int> ord = create_branches_dag(graph, root);
+
+  // loop detected
+  if((int)ord.size() != station_num){
+    for(int i = 0; i < station_num; i++){
+      if((int)graph[i].left.size() == 0 && (int)graph[i].right.size() == 2){
+        std::swap(graph[i].left, graph[i].right);
+      }
+      if((int)graph[i].left.size() == 2 && (int)graph[i].right.size() == 0){
+        graph[i].right.push_back(graph[i].left.back());
+        graph[i].left.pop_back();
+      }
+    }
+    ord = create_branches_dag(graph, root);
+    if((int)ord.size() != station_num) ord = break_branches_dag_cycles(root);
+  }
+
+  NEXT_STATION_CHECK((int)ord.size() == station_num);
+
+  std::vector<std::vector<int>> aligned_root = peel_branches_dag(root, ord);
+
+  // build
+  std::vector<std::vector<int>> aligned_root_in(station_num);
+  for(int i = 0; i < station_num; i++){
+    for(const int x : aligned_root[i]){
+      aligned_root_in[x].push_back(i);
+    }
+  }
+  if(graph[ord[0]].station->geometry[0][0].lng > graph[ord.back()].station->geometry[0][0].lng){
+    std::swap(aligned_root, aligned_root_in);
+  }
+  for(int i = 0; i < station_num; i++){
+    graph[i].left = aligned_root_in[i];
+    graph[i].right = aligned_root[i];
+  }
+}
+
+// sが含まれるgraph
+// dirs_count[d]: 隣の駅の数がdの駅の数(d <= 3)
+inline RailwayType find_railway_type(const int station_num, const int dirs_count[4]){
+  if(station_num == 1) return RailwayType::None;
+  if(dirs_count[1] == 2 && dirs_count[2] == station_num-2) return RailwayType::LinearList;
+  if(dirs_count[1] == 0 && dirs_count[2] == station_num) return RailwayType::Circle;
+  if(dirs_count[1] == 1 && dirs_count[3] == 1 && dirs_count[2] == station_num-2) return RailwayType::WithLoop;
+  return RailwayType::WithBranches;
+}
+
+inline RailwayType find_railway_type(const std::vector<NextStaInfo> &graph){
+  int dirs_count[4] = {};
+  for(const auto &data : graph){
+    const int dirs = data.size();
+    if(dirs <= 3) dirs_count[dirs]++;
+  }
+  return find_railway_type(graph.size(), dirs_count);
+}
+
+// 隣駅の計算に必要なデータと設定をまとめたもの
+// 駅と path を入れて prepare() を呼んだ後は,calculate_next_station() を複数のスレッドから同時に呼んでよい
+// コンテキストどうしは状態を共有しないので,別々のスレッドでそれぞれのコンテキストを使える
+struct NextStationContext {
+  int railway_num = 0;
+  double snap_tolerance = 0; // 0なら座標が完全に一致する点だけを同じ頂点とする(PosIndex を参照)
+  std::atomic<long long> bfs_expanded_nodes{0}; // 駅ごとのBFSで取り出した頂点の総数
+  std::vector<Station> stations;
+  std::vector<std::vector<const Station*>> stations_by_railway; // 路線ごとの stations の要素
+  std::vector<std::vector<Path>> railway_paths;
+  std::vector<RailwayStats> railway_stats; // 路線の数だけ要素を入れておくと calculate_next_station が路線ごとの時間と数を入れる
+
+  NextStationContext() = default;
+  // stations_by_railway が stations の要素を指すのでコピーしない
+  NextStationContext(const NextStationContext&) = delete;
+  NextStationContext &operator=(const NextStationContext&) = delete;
+
+  // 駅と path を入れ終わったら計算の前に1度だけ呼ぶ
+  void prepare(){
+    remove_duplicate_paths();
+    bucket_stations();
+  }
+
+  std::vector<NextStaInfo> calculate_next_station(const int search_id){
+    std::vector<NextStaInfo> next_station_data;
+    const auto &railway_stations = stations_by_railway[search_id];
+    // 複数のスレッドから呼ばれるので路線のデータは書き換えない
+    std::vector<Path> paths = railway_paths[search_id];
+    RailwayStats *stats = railway_stats.empty() ? nullptr : &railway_stats[search_id];
+    bfs_expanded_nodes += search_next_station(railway_stations, next_station_data, paths, snap_tolerance, stats);
+    if(snap_tolerance > 0) make_next_stations_symmetric(next_station_data);
+    StatsLap lap(stats);
+
+    std::vector<NextStaInfo> result_next_station;
+    result_next_station.reserve(railway_stations.size());
+    int tot_station_num = 0;
+    for(auto &graph : separate_to_connected_graph(std::move(next_station_data))){
+      for(int i = 0; i < (int)graph.size(); i++){
+        NEXT_STATION_CHECK(graph[i].index == i);
+      }
+      const RailwayType type = find_railway_type(graph);
+
+      // RailwayType::None は1駅だけなのでそのまま
+      if(type == RailwayType::LinearList){
+        calc_linear_list_graph(graph);
+      }else if(type == RailwayType::Circle){
+        calc_circle_graph(graph);
+      }else if(type == RailwayType::WithLoop){
+        calc_with_loop_graph(graph);
+      }else if(type == RailwayType::WithBranches){
+        calc_with_branches_graph(graph);
+      }
+      for(auto &data : graph){
+        data.index += tot_station_num;
+        for(int &x : data.left) x += tot_station_num;
+        for(int &x : data.right) x += tot_station_num;
+        result_next_station.push_back(std::move(data));
+      }
+      tot_station_num += graph.size();
+    }
+
+    NEXT_STATION_CHECK(result_next_station.size() == railway_stations.size());
+    lap(&RailwayStats::orient_ms);
+
+    return result_next_station;
+  }
+
+  // 全路線をthread_num個のスレッドで計算するときに,路線ごとにf(railway_id)を呼ぶ
+  // pathの多い路線から順に割り当てる
+  template<class F>
+  void for_each_railway(const int thread_num, F f) const{
+    std::vector<int> order(railway_num);
+    for(int i = 0; i < railway_num; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](const int a, const int b){
+      return railway_paths[a].size() > railway_paths[b].size();
+    });
+    std::atomic<int> next_idx(0);
+    // 最初に投げられた例外を全てのスレッドを join した後に呼び出し元へ投げ直す
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&](){
+      while(true){
+        const int idx = next_idx++;
+        if(idx >= railway_num) break;
+        try{
+          f(order[idx]);
+        }catch(...){
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if(!error) error = std::current_exception();
+          next_idx = railway_num;
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    for(int i = 1; i < thread_num; i++) workers.emplace_back(worker);
+    worker();
+    for(auto &th : workers) th.join();
+    if(error) std::rethrow_exception(error);
+  }
+
+private:
+  // 駅を路線ごとに分ける
+  void bucket_stations(){
+    stations_by_railway.assign(railway_num, {});
+    for(const auto &sta : stations){
+      stations_by_railway[sta.railway_id].push_back(&sta);
+    }
+  }
+
+  // 重複したpathを削除する
+  // ハッシュで重複を除いてから,結果が変わらないように従来どおり座標の辞書順に並べる
+  // (重複のないpathどうしの比較はほとんど先頭の座標で決まる)
+  void remove_duplicate_paths(){
+    for(auto &paths : railway_paths){
+      const int path_num = paths.size();
+      size_t cap = 2;
+      while(cap < (size_t)path_num * 2) cap <<= 1;
+      std::vector<int> table(cap, -1);
+      std::vector<uint64_t> hashes(path_num);
+      int count = 0;
+      for(int i = 0; i < path_num; i++){
+        uint64_t h = paths[i].size();
+        for(const Pos &p : paths[i]) h = hash_mix(h ^ hash_pos(p));
+        size_t slot = h & (cap - 1);
+        bool duplicate = false;
+        while(table[slot] != -1){
+          const int j = table[slot];
+          if(hashes[j] == h && paths[j] == paths[i]){
+            duplicate = true;
+            break;
+          }
+          slot = (slot + 1) & (cap - 1);
+        }
+        if(duplicate) continue;
+        if(count != i) paths[count] = std::move(paths[i]);
+        hashes[count] = h;
+        table[slot] = count;
+        count++;
+      }
+      paths.resize(count);
+      std::sort(paths.begin(), paths.end());
+    }
+  }
+};
+
+// 全路線の結果を出力の順に駅を並べた配列にしたもの
+// left/right はこの並びでの駅の番号で,i番目の駅のleftは left[left_offset[i]] から left[left_offset[i+1]-1] まで
+struct NextStationArrays {
+  std::vector<int32_t> station_codes;
+  std::vector<uint32_t> left_offset = { 0 }, right_offset = { 0 }, left, right;
+  explicit NextStationArrays(const std::vector<std::vector<NextStaInfo>> &railway_results){
+    for(const auto &next_station_data : railway_results){
+      const uint32_t base = station_codes.size();
+      for(const auto &data : next_station_data){
+        station_codes.push_back(data.station->station_code);
+        for(const int x : data.left) left.push_back(base + x);
+        for(const int x : data.right) right.push_back(base + x);
+        left_offset.push_back(left.size());
+        right_offset.push_back(right.size());
+      }
+    }
+  }
+};
+
+// 路線の隣駅のグラフ(graph[i]: i番目の駅の隣の駅の番号)を,連結成分ごとに線路の順に辿った駅の番号の列にする
+// init-database.js の RailPaths が線路の形を作るのに使う
+// 1駅だけの成分は空の列になり,枝分かれのある成分は根からDFSで辿った順(戻るときの駅も含む)になる
+struct RailwayPathCalculator {
+  explicit RailwayPathCalculator(const std::vector<std::vector<int>> &graph) : graph(graph), tree(graph.size()), visited(graph.size()){}
+
+  std::vector<std::vector<int>> get_graph_paths(){
+    const int station_num = graph.size();
+    for(int i = 0; i < station_num; i++){
+      for(const int x : graph[i]) tree.unite(i, x);
+    }
+    std::vector<std::vector<int>> members(station_num);
+    for(int i = 0; i < station_num; i++) members[tree.root(i)].push_back(i);
+
+    std::vector<std::vector<int>> paths;
+    for(int i = 0; i < station_num; i++){
+      if(tree.root(i) != i) continue;
+      paths.push_back(get_path(i, members[i]));
+    }
+    return paths;
+  }
+
+private:
+  const std::vector<std::vector<int>> &graph;
+  UnionFind tree;
+  std::vector<char> visited;
+
+  std::vector<int> get_path(const int st, const std::vector<int> &members){
+    int dirs_count[4] = {};
+    int min_dirs = 10, start_pos = -1;
+    for(const int i : members){
+      const int d = graph[i].size();
+      if(d <= 3) dirs_count[d]++;
+      if(min_dirs > d){
+        min_dirs = d;
+        start_pos = i;
+      }
+    }
+    switch(find_railway_type(members.size(), dirs_count)){
+      case RailwayType::LinearList: return linear_list_path(start_pos);
+      case RailwayType::Circle: return circle_path(start_pos);
+      case RailwayType::WithLoop: return with_loop_path(start_pos);
+      case RailwayType::WithBranches: return with_branches_path(st, members);
+      default: return {};
+    }
+  }
+
+  std::vector<int> linear_list_path(const int start_pos) const{
+    int cur = start_pos, prev = -1;
+    std::vector<int> path = { cur };
+    while(true){
+      if(prev != graph[cur][0]){
+        prev = cur;
+        cur = graph[cur][0];
+      }else if(graph[cur].size() >= 2){
+        prev = cur;
+        cur = graph[cur][1];
+      }else break;
+      path.push_back(cur);
+    }
+    return path;
+  }
+
+  std::vector<int> circle_path(const int start_pos) const{
+    int cur = start_pos, prev = -1;
+    std::vector<int> path;
+    while(true){
+      path.push_back(cur);
+      const int next = prev != graph[cur][0] ? graph[cur][0] : graph[cur][1];
+      prev = cur;
+      cur = next;
+      if(cur == start_pos) break;
+    }
+    path.push_back(cur);
+    return path;
+  }
+
+  // 端の駅からループを1周して分岐点に戻るまで
+  std::vector<int> with_loop_path(const int start_pos) const{
+    int cur = start_pos, prev = -1;
+    bool visited_branch = false;
+    std::vector<int> path;
+    while(true){
+      path.push_back(cur);
+      if(graph[cur].size() <= 2){
+        if(prev != graph[cur][0]){
+          prev = cur;
+          cur = graph[cur][0];
+        }else if(graph[cur].size() >= 2){
+          prev = cur;
+          cur = graph[cur][1];
+        }
+      }else{
+        if(visited_branch) break;
+        visited_branch = true;
+        const int next = prev != graph[cur][0] ? graph[cur][0] : graph[cur][1];
+        prev = cur;
+        cur = next;
+      }
+    }
+    return path;
+  }
+
+  // 辺の数だけ進んだら止める
+  std::vector<int> with_branches_path(const int st, const std::vector<int> &members){
+    int edges_num = 0;
+    for(const int i : members) edges_num += graph[i].size();
+    edges_num >>= 1;
+    std::vector<int> path;
+    auto dfs = [&](auto &&self, const int pos, const int par) -> void {
+      path.push_back(pos);
+      edges_num--;
+      if(edges_num < 0) return;
+      if(visited[pos]) return;
+      visited[pos] = 1;
+      for(const int p : graph[pos]){
+        if(p == par) continue;
+        self(self, p, pos);
+        if(edges_num < 0) return;
+        path.push_back(pos);
+      }
+    };
+    dfs(dfs, st, -1);
+    return path;
+  }
+};
@@ -0,0 +1,292 @@
+// calc と同じ隣駅の計算を Node のプロセス内で行う addon (node-gyp でビルドする)
+// calculate(railroadBin, options) は railroad.bin の内容の Buffer(TypedArray) を受け取り,
+// 計算を libuv のスレッドで行って create.js の read_next_station_binary と同じ形のオブジェクトで resolve する Promise を返す
+//   options.threads : 路線ごとに並列に計算するスレッドの数(省略すると1)
+//   options.snap    : calc の --snap と同じ(省略すると0)
+//   options.cache   : calc の --cache と同じ,路線ごとの結果をこのファイルにキャッシュする(省略するとキャッシュしない)
+// 呼び出しごとに別々の NextStationContext を使うので,複数の呼び出しや worker_threads から同時に使ってよい
+// railPaths(stationNums, neighborOffsets, neighbors) は calc --rail-paths と同じ計算を同期的に行う(railPaths.js が使う)
+//   stationNums[r]                                           : 路線rの駅の数(駅は路線の順に通し番号をつける)
+//   neighbors.subarray(neighborOffsets[i], neighborOffsets[i+1]) : 通し番号iの駅の隣の駅の,路線の中での番号
+//   返り値 { pathNums, pathOffsets, stations } : 路線rの列の数が pathNums[r] で,列は路線の順に通し番号をつけ,
+//                                              列kの駅の路線の中での番号が stations.subarray(pathOffsets[k], pathOffsets[k+1])
+#include <node_api.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "next_station.hpp"
+#include "railroad_bin.hpp"
+#include "result_cache.hpp"
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#ifndef NODE_GYP_MODULE_NAME
+#define NODE_GYP_MODULE_NAME next_station
+#endif
+
+#define NAPI_CALL(env, call) \
+  do{ \
+    if((call) != napi_ok){ \
+      napi_throw_error((env), nullptr, "N-API call failed: " #call); \
+      return nullptr; \
+    } \
+  }while(0)
+
+struct CalculateTask {
+  NextStationContext ctx;
+  int thread_num = 1;
+  std::unique_ptr<NextStationArrays> arrays;
+  napi_async_work work = nullptr;
+  napi_deferred deferred = nullptr;
+  std::string error; // 計算中に投げられた例外のメッセージ
+  std::string cache_file; // 空ならキャッシュしない
+};
+
+// この addon (next_station.node) のファイルの内容のハッシュ,特定できなければ0を返す
+static uint64_t addon_build_id(){
+#ifndef _WIN32
+  Dl_info info;
+  if(dladdr(reinterpret_cast<const void*>(&addon_build_id), &info) && info.dli_fname) return file_hash(info.dli_fname);
+#endif
+  return 0;
+}
+
+// JSのスレッドには触れないので,ctx と結果だけを使う
+// 例外は libuv のスレッドの外に出さず,complete_calculate で reject する
+static void execute_calculate(napi_env, void *data){
+  auto *task = static_cast<CalculateTask*>(data);
+  try{
+    task->ctx.prepare();
+    ResultCache cache;
+    const bool use_cache = !task->cache_file.empty() && cache.open(task->cache_file.c_str(), addon_build_id(), task->ctx.railway_num);
+    std::vector<std::vector<NextStaInfo>> railway_results(task->ctx.railway_num);
+    task->ctx.for_each_railway(task->thread_num, [&](const int id){
+      railway_results[id] = use_cache ? cache.calculate(task->ctx, id) : task->ctx.calculate_next_station(id);
+    });
+    if(use_cache) cache.save();
+    task->arrays = std::make_unique<NextStationArrays>(railway_results);
+  }catch(const std::exception &e){
+    task->error = e.what();
+  }catch(...){
+    task->error = "unknown error in calculation";
+  }
+}
+
+template<class T>
+static napi_value create_typed_array(napi_env env, const std::vector<T> &values, const napi_typedarray_type type){
+  void *data;
+  napi_value arraybuffer, array;
+  NAPI_CALL(env, napi_create_arraybuffer(env, values.size() * sizeof(T), &data, &arraybuffer));
+  if(!values.empty()) std::memcpy(data, values.data(), values.size() * sizeof(T));
+  NAPI_CALL(env, napi_create_typedarray(env, type, values.size(), arraybuffer, 0, &array));
+  return array;
+}
+
+static napi_value create_result(napi_env env, const NextStationArrays &arrays){
+  napi_value result;
+  NAPI_CALL(env, napi_create_object(env, &result));
+  const std::pair<const char*, napi_value> fields[] = {
+    { "stationCodes", create_typed_array(env, arrays.station_codes, napi_int32_array) },
+    { "leftOffsets", create_typed_array(env, arrays.left_offset, napi_uint32_array) },
+    { "rightOffsets", create_typed_array(env, arrays.right_offset, napi_uint32_array) },
+    { "left", create_typed_array(env, arrays.left, napi_uint32_array) },
+    { "right", create_typed_array(env, arrays.right, napi_uint32_array) },
+  };
+  for(const auto &[name, value] : fields){
+    if(!value) return nullptr;
+    NAPI_CALL(env, napi_set_named_property(env, result, name, value));
+  }
+  return result;
+}
+
+static void complete_calculate(napi_env env, napi_status status, void *data){
+  std::unique_ptr<CalculateTask> task(static_cast<CalculateTask*>(data));
+  napi_value result = status == napi_ok && task->error.empty() ? create_result(env, *task->arrays) : nullptr;
+  if(result){
+    napi_resolve_deferred(env, task->deferred, result);
+  }else{
+    napi_value error = nullptr;
+    bool pending = false;
+    napi_is_exception_pending(env, &pending);
+    if(pending){
+      napi_get_and_clear_last_exception(env, &error);
+    }else{
+      const char *text = !task->error.empty() ? task->error.c_str() : "calculation was cancelled";
+      napi_value message;
+      napi_create_string_utf8(env, text, NAPI_AUTO_LENGTH, &message);
+      napi_create_error(env, nullptr, message, &error);
+    }
+    napi_reject_deferred(env, task->deferred, error);
+  }
+  napi_delete_async_work(env, task->work);
+}
+
+// optionsにnameがあればvalueに入れる,文字列でなければfalseを返す
+static bool get_string_option(napi_env env, napi_value options, const char *name, std::string &value){
+  bool has = false;
+  if(napi_has_named_property(env, options, name, &has) != napi_ok || !has) return true;
+  napi_value prop;
+  size_t length;
+  if(napi_get_named_property(env, options, name, &prop) != napi_ok) return false;
+  if(napi_get_value_string_utf8(env, prop, nullptr, 0, &length) != napi_ok) return false;
+  value.resize(length + 1);
+  if(napi_get_value_string_utf8(env, prop, value.data(), value.size(), &length) != napi_ok) return false;
+  value.resize(length);
+  return true;
+}
+
+// optionsにnameがあればvalueに入れる,数値でなければfalseを返す
+static bool get_number_option(napi_env env, napi_value options, const char *name, double &value){
+  bool has = false;
+  if(napi_has_named_property(env, options, name, &has) != napi_ok || !has) return true;
+  napi_value prop;
+  if(napi_get_named_property(env, options, name, &prop) != napi_ok) return false;
+  return napi_get_value_double(env, prop, &value) == napi_ok;
+}
+
+static napi_value calculate(napi_env env, napi_callback_info info){
+  size_t argc = 2;
+  napi_value argv[2];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr));
+  bool is_typedarray = false;
+  if(argc >= 1) NAPI_CALL(env, napi_is_typedarray(env, argv[0], &is_typedarray));
+  if(!is_typedarray){
+    napi_throw_type_error(env, nullptr, "calculate: the first argument must be a Buffer of railroad.bin");
+    return nullptr;
+  }
+  napi_typedarray_type type;
+  size_t length;
+  void *data;
+  NAPI_CALL(env, napi_get_typedarray_info(env, argv[0], &type, &length, &data, nullptr, nullptr));
+  if(type != napi_uint8_array){
+    napi_throw_type_error(env, nullptr, "calculate: the first argument must be a Buffer of railroad.bin");
+    return nullptr;
+  }
+
+  auto task = std::make_unique<CalculateTask>();
+  double threads = 1;
+  if(argc >= 2){
+    napi_valuetype options_type;
+    NAPI_CALL(env, napi_typeof(env, argv[1], &options_type));
+    if(options_type == napi_object){
+      if(!get_number_option(env, argv[1], "threads", threads) || !get_number_option(env, argv[1], "snap", task->ctx.snap_tolerance)){
+        napi_throw_type_error(env, nullptr, "calculate: options.threads and options.snap must be numbers");
+        return nullptr;
+      }
+      if(!get_string_option(env, argv[1], "cache", task->cache_file)){
+        napi_throw_type_error(env, nullptr, "calculate: options.cache must be a string");
+        return nullptr;
+      }
+    }else if(options_type != napi_undefined){
+      napi_throw_type_error(env, nullptr, "calculate: options must be an object");
+      return nullptr;
+    }
+  }
+  task->thread_num = std::max(1, (int)threads);
+
+  // Bufferの中身はJSから書き換えられるので,ワーカーに渡す前にここでコピーしておく
+  if(const char *reason = read_railroad_bin(task->ctx, static_cast<const char*>(data), length)){
+    napi_throw_error(env, nullptr, (std::string("calculate: invalid railroad.bin (") + reason + ")").c_str());
+    return nullptr;
+  }
+
+  napi_value promise, resource_name;
+  NAPI_CALL(env, napi_create_promise(env, &task->deferred, &promise));
+  NAPI_CALL(env, napi_create_string_utf8(env, "next_station.calculate", NAPI_AUTO_LENGTH, &resource_name));
+  NAPI_CALL(env, napi_create_async_work(env, nullptr, resource_name, execute_calculate, complete_calculate, task.get(), &task->work));
+  NAPI_CALL(env, napi_queue_async_work(env, task->work));
+  task.release();
+  return promise;
+}
+
+// value が Uint32Array なら中身と長さを返す
+static bool get_uint32_array(napi_env env, napi_value value, const uint32_t *&data, size_t &length){
+  bool is_typedarray = false;
+  if(napi_is_typedarray(env, value, &is_typedarray) != napi_ok || !is_typedarray) return false;
+  napi_typedarray_type type;
+  void *ptr;
+  if(napi_get_typedarray_info(env, value, &type, &length, &ptr, nullptr, nullptr) != napi_ok || type != napi_uint32_array) return false;
+  data = static_cast<const uint32_t*>(ptr);
+  return true;
+}
+
+static napi_value rail_paths(napi_env env, napi_callback_info info){
+  size_t argc = 3;
+  napi_value argv[3];
+  NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr));
+  const uint32_t *station_nums, *neighbor_offsets, *neighbors;
+  size_t railway_num, offset_num, neighbor_num;
+  if(argc < 3 || !get_uint32_array(env, argv[0], station_nums, railway_num) ||
+     !get_uint32_array(env, argv[1], neighbor_offsets, offset_num) || !get_uint32_array(env, argv[2], neighbors, neighbor_num)){
+    napi_throw_type_error(env, nullptr, "railPaths: the arguments must be Uint32Arrays");
+    return nullptr;
+  }
+  size_t station_total = 0;
+  for(size_t r = 0; r < railway_num; r++) station_total += station_nums[r];
+  if(offset_num != station_total + 1 || neighbor_offsets[0] != 0 || neighbor_offsets[station_total] != neighbor_num){
+    napi_throw_range_error(env, nullptr, "railPaths: neighborOffsets does not match stationNums and neighbors");
+    return nullptr;
+  }
+
+  std::vector<uint32_t> path_nums, path_offsets = { 0 }, stations;
+  try{
+    size_t first = 0;
+    for(size_t r = 0; r < railway_num; r++){
+      const size_t station_num = station_nums[r];
+      std::vector<std::vector<int>> graph(station_num);
+      for(size_t i = 0; i < station_num; i++){
+        const size_t begin = neighbor_offsets[first + i], end = neighbor_offsets[first + i + 1];
+        if(begin > end || end > neighbor_num){
+          napi_throw_range_error(env, nullptr, "railPaths: neighborOffsets must be non-decreasing");
+          return nullptr;
+        }
+        for(size_t k = begin; k < end; k++){
+          if(neighbors[k] >= station_num){
+            napi_throw_range_error(env, nullptr, ("railPaths: station index " + std::to_string(neighbors[k]) + " is out of range in railway " + std::to_string(r)).c_str());
+            return nullptr;
+          }
+          graph[i].push_back(neighbors[k]);
+        }
+      }
+      first += station_num;
+      const auto paths = RailwayPathCalculator(graph).get_graph_paths();
+      path_nums.push_back(paths.size());
+      for(const auto &path : paths){
+        stations.insert(stations.end(), path.begin(), path.end());
+        path_offsets.push_back(stations.size());
+      }
+    }
+  }catch(const std::exception &e){
+    napi_throw_error(env, nullptr, (std::string("railPaths: ") + e.what()).c_str());
+    return nullptr;
+  }
+
+  napi_value result;
+  NAPI_CALL(env, napi_create_object(env, &result));
+  const std::pair<const char*, napi_value> fields[] = {
+    { "pathNums", create_typed_array(env, path_nums, napi_uint32_array) },
+    { "pathOffsets", create_typed_array(env, path_offsets, napi_uint32_array) },
+    { "stations", create_typed_array(env, stations, napi_uint32_array) },
+  };
+  for(const auto &[name, value] : fields){
+    if(!value) return nullptr;
+    NAPI_CALL(env, napi_set_named_property(env, result, name, value));
+  }
+  return result;
+}
+
+static napi_value init(napi_env env, napi_value exports){
+  const std::pair<const char*, napi_callback> functions[] = {
+    { "calculate", calculate },
+    { "railPaths", rail_paths },
+  };
+  for(const auto &[name, callback] : functions){
+    napi_value fn;
+    NAPI_CALL(env, napi_create_function(env, name, NAPI_AUTO_LENGTH, callback, nullptr, &fn));
+    NAPI_CALL(env, napi_set_named_property(env, exports, name, fn));
+  }
+  return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -1,224 +1,119 @@
-class UnionFind {
-  constructor(n) {
-    this.d = new Array(n).fill(-1);
-  }
-  root(x) {
-    if (this.d[x] < 0) return x;
-    return (this.d[x] = this.root(this.d[x]));
-  }
-  unite(_x, _y) {
-    let x = _x,
-      y = _y;
-    x = this.root(x);
-    y = this.root(y);
-    if (x === y) return false;
-    if (this.d[x] > this.d[y]) [x, y] = [y, x];
-    this.d[x] += this.d[y];
-    this.d[y] = x;
-    return true;
-  }
-  same(x, y) {
-    return this.root(x) === this.root(y);
-  }
-  size(x) {
-    return -this.d[this.root(x)];
-  }
-}
-
-class CalcRailwayPath {
-  constructor(graph) {
-    this.graph = graph;
-    this.type = Object.freeze({
-      None: 0,
-      LinearList: 1,
-      Circle: 2,
-      WithLoop: 3,
-      WithBranches: 4,
+const fs = require("fs");
+const path = require("path");
+const { execFileSync } = require("child_process");
+const { load_next_station_addon } = require("./create");
+
+// data/calc が --rail-paths に対応しているか
+// 路線が0個の入力では何も出力しないはず(古い calc は引数を無視して線路のデータとして読み,"[" などを出力する)
+const supports_rail_paths = (calc_path) => {
+  if (!fs.existsSync(calc_path)) return false;
+  try {
+    const output = execFileSync(calc_path, ["--rail-paths"], {
+      input: "0\n",
+      stdio: ["pipe", "pipe", "ignore"],
     });
+    return output.toString().trim() === "";
+  } catch (err) {
+    return false;
+  }
+};
+
+// data/calc がないか古くて --rail-paths に対応していなければ,create.js と同じようにコンパイルする
+const prepare_calc = () => {
+  const calc_path = path.join(__dirname, "data/calc");
+  if (supports_rail_paths(calc_path)) return calc_path;
+  console.log("Compile calc.cpp for --rail-paths");
+  fs.mkdirSync(path.join(__dirname, "data"), { recursive: true });
+  try {
+    execFileSync("g++", ["calc.cpp", "-o", "data/calc", "-O2", "-pthread"], {
+      cwd: __dirname,
+      stdio: "inherit",
+    });
+  } catch (err) {
+    throw new Error(
+      `cannot compile calc.cpp (${err.message}); build the addon with npm run build-addon instead`
+    );
   }
-
-  get_graph_paths() {
-    let tree = new UnionFind(this.graph.length);
-    for (let i = 0; i < this.graph.length; i++) {
-      for (let j = 0; j < this.graph[i].length; j++) {
-        tree.unite(i, this.graph[i][j]);
-      }
-    }
-
-    let paths = []; // indices
-    for (let i = 0; i < this.graph.length; i++) {
-      if (tree.root(i) !== i) continue;
-      const path = this.get_path(i, tree);
-      paths.push(path);
-    }
-
-    return paths;
-  }
-
-  get_path(st, tree) {
-    let path = []; // indices
-
-    switch (this.get_graph_type(st, tree)) {
-      case this.type.None:
-        break;
-      case this.type.LinearList:
-        path = this.linear_list_graph(st, tree);
-        break;
-      case this.type.Circle:
-        path = this.circle_graph(st, tree);
-        break;
-      case this.type.WithLoop:
-        path = this.with_loop_graph(st, tree);
-        break;
-      case this.type.WithBranches:
-        path = this.with_branches_graph(st, tree);
-        break;
-    }
-    return path;
-  }
-
-  min_dirs_poses(st, tree) {
-    const root = tree.root(st);
-    let info = [];
-    let min_dirs = 10;
-    for (let i = 0; i < this.graph.length; i++) {
-      if (tree.root(i) !== root) continue;
-      const d = this.graph[i].length;
-      info.push({ pos: i, dir: d });
-      if (min_dirs > d) min_dirs = d;
-    }
-    return info.filter((elem) => elem.dir === min_dirs).map((elem) => elem.pos);
-  }
-
-  linear_list_graph(st, tree) {
-    const start_pos = this.min_dirs_poses(st, tree)[0];
-    let cur = start_pos,
-      prev = -1;
-
-    let path = [cur];
-    while (true) {
-      if (prev !== this.graph[cur][0]) {
-        prev = cur;
-        cur = this.graph[cur][0];
-      } else if (this.graph[cur].length >= 2) {
-        prev = cur;
-        cur = this.graph[cur][1];
-      } else break;
-      path.push(cur);
-    }
-    return path;
-  }
-
-  circle_graph(st, tree) {
-    const start_pos = this.min_dirs_poses(st, tree)[0];
-    let cur = start_pos,
-      prev = -1;
-
-    let path = [];
-    while (true) {
-      path.push(cur);
-      if (prev !== this.graph[cur][0]) {
-        prev = cur;
-        cur = this.graph[cur][0];
-      } else {
-        prev = cur;
-        cur = this.graph[cur][1];
-      }
-      if (cur === start_pos) break;
-    }
-    path.push(cur);
-    return path;
-  }
-
-  with_loop_graph(st, tree) {
-    const start_pos = this.min_dirs_poses(st, tree)[0];
-    let cur = start_pos,
-      prev = -1;
-    let visited_branch = false;
-
-    let path = [];
-    while (true) {
-      path.push(cur);
-      if (this.graph[cur].length <= 2) {
-        if (prev !== this.graph[cur][0]) {
-          prev = cur;
-          cur = this.graph[cur][0];
-        } else if (this.graph[cur].length >= 2) {
-          prev = cur;
-          cur = this.graph[cur][1];
-        }
-      } else {
-        if (visited_branch) {
-          break;
-        }
-        visited_branch = true;
-        if (prev !== this.graph[cur][0]) {
-          prev = cur;
-          cur = this.graph[cur][0];
-        } else {
-          prev = cur;
-          cur = this.graph[cur][1];
-        }
-      }
+  if (!supports_rail_paths(calc_path)) {
+    throw new Error(`${calc_path} does not support --rail-paths`);
+  }
+  return calc_path;
+};
+
+// 線路の形は next_station.hpp の RailwayPathCalculator で計算する
+// addon (npm run build-addon) があればプロセス内で,なければ data/calc の --rail-paths で計算する
+// 入出力は addon の railPaths と同じ平らな配列(next_station_addon.cpp を参照)
+const calc_rail_paths_flat = (station_nums, neighbor_offsets, neighbors) => {
+  const addon = load_next_station_addon();
+  if (addon) return addon.railPaths(station_nums, neighbor_offsets, neighbors);
+
+  const calc_path = prepare_calc();
+  const lines = [station_nums.length];
+  let first = 0;
+  station_nums.forEach((station_num) => {
+    lines.push(station_num);
+    for (let i = first; i < first + station_num; i++) {
+      const list = neighbors.subarray(neighbor_offsets[i], neighbor_offsets[i + 1]);
+      lines.push([list.length, ...list].join(" "));
     }
-    return path;
-  }
-
-  with_branches_graph(st, tree) {
-    let edges_num = 0;
-    const root = tree.root(st);
-    for (let i = 0; i < this.graph.length; i++) {
-      if (root !== tree.root(i)) continue;
-      edges_num += this.graph[i].length;
+    first += station_num;
+  });
+  const output = execFileSync(calc_path, ["--rail-paths"], {
+    input: lines.join("\n") + "\n",
+    maxBuffer: 1 << 30,
+  })
+    .toString()
+    .split(/\s+/)
+    .filter((token) => token !== "")
+    .map((token) => +token);
+
+  let pos = 0;
+  const path_nums = [];
+  const path_offsets = [0];
+  const stations = [];
+  station_nums.forEach(() => {
+    const path_num = output[pos++];
+    path_nums.push(path_num);
+    for (let k = 0; k < path_num; k++) {
+      const len = output[pos++];
+      for (let j = 0; j < len; j++) stations.push(output[pos++]);
+      path_offsets.push(stations.length);
     }
-    edges_num >>= 1;
-
-    let path = [];
-    let visited = {};
-
-    const dfs = (pos, par) => {
-      path.push(pos);
-      edges_num--;
-      if (edges_num < 0) return;
-      if (pos in visited) return;
-      visited[pos] = true;
-      for (let i = 0; i < this.graph[pos].length; i++) {
-        const p = this.graph[pos][i];
-        if (p === par) continue;
-        dfs(p, pos);
-        if (edges_num < 0) return;
-        path.push(pos);
-      }
-    };
-    dfs(st, -1);
-
-    return path;
-  }
-
-  get_graph_type(st, tree) {
-    const root = tree.root(st);
-    let dirs_count = [0, 0, 0, 0];
-    let station_num = 0;
-    for (let i = 0; i < this.graph.length; i++) {
-      if (tree.root(i) !== root) continue;
-      const d = this.graph[i].length;
-      if (d <= 3) dirs_count[d]++;
-      station_num++;
-    }
-    if (station_num === 1) return this.type.None;
-    if (dirs_count[1] == 2 && dirs_count[2] == station_num - 2)
-      return this.type.LinearList;
-    if (dirs_count[1] == 0 && dirs_count[2] == station_num)
-      return this.type.Circle;
-    if (
-      dirs_count[1] == 1 &&
-      dirs_count[3] == 1 &&
-      dirs_count[2] == station_num - 2
-    )
-      return this.type.WithLoop;
-    return this.type.WithBranches;
-  }
-}
+  });
+  return {
+    pathNums: Uint32Array.from(path_nums),
+    pathOffsets: Uint32Array.from(path_offsets),
+    stations: Uint32Array.from(stations),
+  };
+};
+
+// graphs[r][i]: 路線rのi番目の駅の隣の駅の番号
+// 路線ごとに,線路の順に辿った駅の番号の列のlistを返す
+const calc_rail_paths = (graphs) => {
+  const station_nums = Uint32Array.from(graphs, (graph) => graph.length);
+  const neighbor_offsets = [0];
+  const neighbors = [];
+  graphs.forEach((graph) =>
+    graph.forEach((list) => {
+      neighbors.push(...list);
+      neighbor_offsets.push(neighbors.length);
+    })
+  );
+  const { pathNums, pathOffsets, stations } = calc_rail_paths_flat(
+    station_nums,
+    Uint32Array.from(neighbor_offsets),
+    Uint32Array.from(neighbors)
+  );
+
+  let k = 0;
+  return Array.from(pathNums, (path_num) =>
+    new Array(path_num).fill().map(() => {
+      const list = Array.from(stations.subarray(pathOffsets[k], pathOffsets[k + 1]));
+      k++;
+      return list;
+    })
+  );
+};
 
 class RailPaths {
   constructor(next_station_data, station_data) {
@@ -238,6 +133,23 @@ class RailPaths {
     this.next_station.forEach((data) => {
       this.graph[data.stationCode] = data.left.concat(data.right);
     });
+
+    // 全路線をまとめて計算する(他の路線の駅への辺は含めない)
+    const railway_list = this.getRailwayList();
+    const graphs = railway_list.map((railwayCode) => {
+      const codes = this.railway_station[railwayCode];
+      let indices = {};
+      codes.forEach((code, i) => (indices[code] = i));
+      return codes.map((code) =>
+        (this.graph[code] || [])
+          .filter((next) => next in indices)
+          .map((next) => indices[next])
+      );
+    });
+    this.paths = {};
+    calc_rail_paths(graphs).forEach((paths, i) => {
+      this.paths[railway_list[i]] = paths;
+    });
   }
 
   getRailwayList() {
@@ -245,23 +157,7 @@ class RailPaths {
   }
 
   getPaths(railwayCode) {
-    const railway_num = this.railway_station[railwayCode].length;
-
-    let indices = {};
-    for (let i = 0; i < railway_num; i++) {
-      indices[this.railway_station[railwayCode][i]] = i;
-    }
-
-    let railway_graph = new Array(railway_num).fill().map((_) => []);
-    for (let i = 0; i < railway_num; i++) {
-      const pos = this.railway_station[railwayCode][i];
-      for (let j = 0; j < this.graph[pos].length; j++) {
-        railway_graph[i].push(indices[this.graph[pos][j]]);
-      }
-    }
-
-    const paths = new CalcRailwayPath(railway_graph).get_graph_paths();
-    return paths.map((path) =>
+    return this.paths[railwayCode].map((path) =>
       path.map((pos) => this.positions[this.railway_station[railwayCode][pos]])
     );
   }
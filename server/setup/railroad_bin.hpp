@@ -0,0 +1,105 @@
+// railroad.bin のフォーマットと読み込み
+// calc.cpp と next_station_addon.cpp で共通
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include "next_station.hpp"
+
+// railroad.bin のフォーマット(little endian)
+// railroad.txt と同じ内容をパースせずにmmapして読めるようにしたもの
+constexpr char RAILROAD_BIN_MAGIC[8] = { 'R', 'A', 'I', 'L', 'B', 'I', 'N', '\0' };
+constexpr uint32_t RAILROAD_BIN_VERSION = 1;
+
+struct RailroadBinHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t station_num;
+  uint32_t railway_num;
+  uint32_t path_num;
+  uint64_t coord_num;
+  uint64_t station_offset; // RailroadBinStation[station_num]
+  uint64_t railway_offset; // uint32_t[railway_num+1], 路線ごとのpathの範囲
+  uint64_t path_offset; // uint64_t[path_num+1], pathごとの座標の範囲
+  uint64_t coord_offset; // double[coord_num*2], lat lng の順
+  uint64_t string_offset; // '\0'終端の文字列の列
+  uint64_t string_size;
+};
+static_assert(sizeof(RailroadBinHeader) == 80);
+
+struct RailroadBinStation {
+  int32_t station_code, railway_id;
+  uint32_t geometry_begin, geometry_end; // 駅の線路のpathの範囲
+  uint32_t railway_name, railway_company, station_name; // 文字列の位置
+  uint32_t reserved;
+};
+static_assert(sizeof(RailroadBinStation) == 32);
+static_assert(sizeof(Pos) == sizeof(double) * 2);
+
+// メモリ上の railroad.bin の内容を ctx に読み込む
+// 成功したらnullptr,不正な内容ならその理由を返す
+inline const char *read_railroad_bin(NextStationContext &ctx, const char *data, const size_t size){
+  auto in_range = [&](const uint64_t offset, const uint64_t count, const uint64_t elem_size){
+    return offset <= size && count <= (size - offset) / elem_size;
+  };
+  if(size < sizeof(RailroadBinHeader)) return "too short";
+  RailroadBinHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if(std::memcmp(header.magic, RAILROAD_BIN_MAGIC, sizeof(header.magic))) return "bad magic";
+  if(header.version != RAILROAD_BIN_VERSION) return "unsupported version";
+  if(!in_range(header.station_offset, header.station_num, sizeof(RailroadBinStation))) return "station table";
+  if(!in_range(header.railway_offset, (uint64_t)header.railway_num + 1, sizeof(uint32_t))) return "railway table";
+  if(!in_range(header.path_offset, (uint64_t)header.path_num + 1, sizeof(uint64_t))) return "path table";
+  if(!in_range(header.coord_offset, header.coord_num, sizeof(Pos))) return "coordinates";
+  if(!in_range(header.string_offset, header.string_size, 1)) return "strings";
+  if(header.string_size && data[header.string_offset + header.string_size - 1] != '\0') return "strings";
+
+  std::vector<uint32_t> railway_begin(header.railway_num + 1);
+  std::memcpy(railway_begin.data(), data + header.railway_offset, railway_begin.size() * sizeof(uint32_t));
+  std::vector<uint64_t> path_begin(header.path_num + 1);
+  std::memcpy(path_begin.data(), data + header.path_offset, path_begin.size() * sizeof(uint64_t));
+  for(uint32_t i = 0; i < header.path_num; i++){
+    if(path_begin[i] > path_begin[i+1] || path_begin[i+1] > header.coord_num) return "path range";
+  }
+  for(uint32_t i = 0; i < header.railway_num; i++){
+    if(railway_begin[i] > railway_begin[i+1] || railway_begin[i+1] > header.path_num) return "railway range";
+  }
+
+  const char *coords = data + header.coord_offset;
+  auto get_path = [&](const uint32_t idx) -> Path {
+    Path path(path_begin[idx+1] - path_begin[idx]);
+    std::memcpy(path.data(), coords + path_begin[idx] * sizeof(Pos), path.size() * sizeof(Pos));
+    return path;
+  };
+  auto get_string = [&](const uint32_t offset) -> std::string {
+    return std::string(data + header.string_offset + offset);
+  };
+
+  ctx.railway_num = header.railway_num;
+  ctx.stations.reserve(header.station_num);
+  for(uint32_t i = 0; i < header.station_num; i++){
+    RailroadBinStation sta;
+    std::memcpy(&sta, data + header.station_offset + i * sizeof(RailroadBinStation), sizeof(sta));
+    if(sta.geometry_begin > sta.geometry_end || sta.geometry_end > header.path_num) return "station geometry";
+    if(sta.railway_id < 0 || sta.railway_id >= ctx.railway_num) return "railway id";
+    for(const uint32_t offset : { sta.railway_name, sta.railway_company, sta.station_name }){
+      if(offset >= header.string_size) return "string offset";
+    }
+    std::vector<Path> geo;
+    geo.reserve(sta.geometry_end - sta.geometry_begin);
+    for(uint32_t j = sta.geometry_begin; j < sta.geometry_end; j++){
+      geo.push_back(get_path(j));
+    }
+    ctx.stations.emplace_back(std::move(geo), sta.station_code, sta.railway_id, get_string(sta.railway_name), get_string(sta.railway_company), get_string(sta.station_name));
+  }
+
+  ctx.railway_paths.resize(ctx.railway_num);
+  for(int i = 0; i < ctx.railway_num; i++){
+    ctx.railway_paths[i].reserve(railway_begin[i+1] - railway_begin[i]);
+    for(uint32_t j = railway_begin[i]; j < railway_begin[i+1]; j++){
+      ctx.railway_paths[i].push_back(get_path(j));
+    }
+  }
+  return nullptr;
+}
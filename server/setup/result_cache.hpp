@@ -0,0 +1,206 @@
+// 路線ごとの計算結果のキャッシュ
+// calc.cpp と next_station_addon.cpp で共通
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include "next_station.hpp"
+
+// 路線ごとの計算結果のキャッシュ(little endian)
+// 路線の駅(駅コードと線路の座標)と path の内容から計算したハッシュをキーにして,次の駅の計算結果を保存する
+// 内容が変わっていない路線は再計算せずにキャッシュの結果を使う
+// calc の実行ファイル(addon なら next_station.node)の内容のハッシュもキーに含めるので,next_station.hpp などを変えてコンパイルし直すと古い結果は使われない
+// calc と addon は別々のファイルなので,同じキャッシュファイルを使っても互いの結果は使わない
+// RESULT_CACHE_VERSION はファイルの形式を変えたときだけ上げる
+//   header: magic[8], version(uint32_t), entry_num(uint32_t)
+//   entry : hash(uint64_t), word_num(uint32_t), uint32_t[word_num]
+//           駅ごとに 路線内の駅の番号, leftの数, rightの数, left..., right...
+constexpr char RESULT_CACHE_MAGIC[8] = { 'R', 'A', 'I', 'L', 'C', 'A', 'C', 'H' };
+constexpr uint32_t RESULT_CACHE_VERSION = 1;
+
+// ファイルの内容のハッシュ,読めなければ0を返す
+inline uint64_t file_hash(const char *file_path){
+  std::ifstream ifs(file_path, std::ios::binary);
+  if(!ifs) return 0;
+  uint64_t h = hash_mix(0);
+  char buf[1 << 16];
+  while(ifs.read(buf, sizeof(buf)) || ifs.gcount()){
+    const size_t n = ifs.gcount();
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+      uint64_t x;
+      std::memcpy(&x, buf + i, sizeof(x));
+      h = hash_mix(h ^ x);
+    }
+    for(; i < n; i++) h = hash_mix(h ^ (unsigned char)buf[i]);
+  }
+  return h;
+}
+
+struct ResultCache {
+  uint64_t build_id = 0; // 計算するプログラムのファイルの file_hash
+
+  // 結果に影響する入力だけをハッシュに含める(path は重複を除いて並べた後のもの)
+  uint64_t railway_hash(const NextStationContext &ctx, const int railway_id) const{
+    uint64_t h = hash_mix(build_id);
+    auto add = [&](const uint64_t x){ h = hash_mix(h ^ x); };
+    auto add_path = [&](const Path &path){
+      add(path.size());
+      for(const auto &p : path) add(hash_pos(p));
+    };
+    uint64_t snap_bits;
+    std::memcpy(&snap_bits, &ctx.snap_tolerance, sizeof(snap_bits));
+    add(snap_bits);
+    add(ctx.stations_by_railway[railway_id].size());
+    for(const Station *sta : ctx.stations_by_railway[railway_id]){
+      add(sta->station_code);
+      add(sta->geometry.size());
+      for(const auto &path : sta->geometry) add_path(path);
+    }
+    add(ctx.railway_paths[railway_id].size());
+    for(const auto &path : ctx.railway_paths[railway_id]) add_path(path);
+    return h;
+  }
+
+  // file_path のキャッシュを読み込んで路線の数だけ結果の場所を用意する
+  // build_id が0(計算するプログラムを特定できない)ならキャッシュを使わずにfalseを返す
+  bool open(const char *path, const uint64_t id, const int railway_num){
+    if(!id){
+      std::cerr << "Warning: cannot identify the calculating binary, ignoring cache " << path << "\n";
+      return false;
+    }
+    file_path = path;
+    build_id = id;
+    load(path);
+    railway_hashes.assign(railway_num, 0);
+    railway_results.assign(railway_num, {});
+    return true;
+  }
+
+  // 路線の結果をキャッシュから取り出すか計算する,別々の路線なら複数のスレッドから呼んでよい
+  std::vector<NextStaInfo> calculate(NextStationContext &ctx, const int railway_id){
+    std::vector<NextStaInfo> next_station_data;
+    railway_hashes[railway_id] = railway_hash(ctx, railway_id);
+    const std::vector<uint32_t> *words = find(railway_hashes[railway_id]);
+    if(words && decode(ctx, railway_id, *words, next_station_data)){
+      railway_results[railway_id] = *words;
+      cached_railways++;
+    }else{
+      next_station_data = ctx.calculate_next_station(railway_id);
+      railway_results[railway_id] = encode(ctx, railway_id, next_station_data);
+    }
+    return next_station_data;
+  }
+
+  // 今回の路線の結果だけを open したファイルに書き出す
+  void save() const{
+    save(file_path.c_str(), railway_hashes, railway_results);
+  }
+
+  std::atomic<int> cached_railways{0}; // キャッシュの結果を使った路線の数
+
+  static std::vector<uint32_t> encode(const NextStationContext &ctx, const int railway_id, const std::vector<NextStaInfo> &next_station_data){
+    const auto &railway_stations = ctx.stations_by_railway[railway_id];
+    std::vector<uint32_t> words;
+    for(const auto &data : next_station_data){
+      // stations_by_railway は stations の順に並んでいる
+      words.push_back(std::lower_bound(railway_stations.begin(), railway_stations.end(), data.station) - railway_stations.begin());
+      words.push_back(data.left.size());
+      words.push_back(data.right.size());
+      words.insert(words.end(), data.left.begin(), data.left.end());
+      words.insert(words.end(), data.right.begin(), data.right.end());
+    }
+    return words;
+  }
+
+  // 壊れている場合はfalseを返す
+  static bool decode(const NextStationContext &ctx, const int railway_id, const std::vector<uint32_t> &words, std::vector<NextStaInfo> &next_station_data){
+    const auto &railway_stations = ctx.stations_by_railway[railway_id];
+    const size_t station_num = railway_stations.size();
+    next_station_data.clear();
+    size_t pos = 0;
+    while(pos < words.size()){
+      if(words.size() - pos < 3 || words[pos] >= station_num) return false;
+      const size_t left_num = words[pos+1], right_num = words[pos+2];
+      pos += 3;
+      if(words.size() - pos < left_num + right_num) return false;
+      for(size_t i = pos; i < pos + left_num + right_num; i++){
+        if(words[i] >= station_num) return false;
+      }
+      const int idx = next_station_data.size();
+      next_station_data.emplace_back(railway_stations[words[pos-3]], idx,
+        std::vector<int>(words.begin() + pos, words.begin() + pos + left_num),
+        std::vector<int>(words.begin() + pos + left_num, words.begin() + pos + left_num + right_num));
+      pos += left_num + right_num;
+    }
+    return next_station_data.size() == station_num;
+  }
+
+  // ファイルがなければ空のキャッシュとする
+  void load(const char *file_path){
+    std::ifstream ifs(file_path, std::ios::binary);
+    if(!ifs) return;
+    char magic[8];
+    uint32_t version, entry_num;
+    ifs.read(magic, sizeof(magic));
+    ifs.read(reinterpret_cast<char*>(&version), sizeof(version));
+    ifs.read(reinterpret_cast<char*>(&entry_num), sizeof(entry_num));
+    if(!ifs || std::memcmp(magic, RESULT_CACHE_MAGIC, sizeof(magic)) || version != RESULT_CACHE_VERSION){
+      std::cerr << "Warning: ignoring invalid cache " << file_path << "\n";
+      return;
+    }
+    for(uint32_t i = 0; i < entry_num; i++){
+      uint64_t hash;
+      uint32_t word_num;
+      ifs.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+      ifs.read(reinterpret_cast<char*>(&word_num), sizeof(word_num));
+      if(!ifs) break;
+      std::vector<uint32_t> words(word_num);
+      ifs.read(reinterpret_cast<char*>(words.data()), word_num * sizeof(uint32_t));
+      if(!ifs) break;
+      entries[hash] = std::move(words);
+    }
+  }
+
+  // 今回の路線の結果だけを書き出す(一時ファイルに書いてから置き換える)
+  static void save(const char *file_path, const std::vector<uint64_t> &hashes, const std::vector<std::vector<uint32_t>> &results){
+    const std::string temp_path = std::string(file_path) + ".tmp";
+    std::ofstream ofs(temp_path, std::ios::binary);
+    std::unordered_map<uint64_t, int> written;
+    for(int i = 0; i < (int)hashes.size(); i++) written.emplace(hashes[i], i);
+    const uint32_t entry_num = written.size();
+    ofs.write(RESULT_CACHE_MAGIC, sizeof(RESULT_CACHE_MAGIC));
+    ofs.write(reinterpret_cast<const char*>(&RESULT_CACHE_VERSION), sizeof(RESULT_CACHE_VERSION));
+    ofs.write(reinterpret_cast<const char*>(&entry_num), sizeof(entry_num));
+    for(int i = 0; i < (int)hashes.size(); i++){
+      if(written[hashes[i]] != i) continue;
+      const uint32_t word_num = results[i].size();
+      ofs.write(reinterpret_cast<const char*>(&hashes[i]), sizeof(hashes[i]));
+      ofs.write(reinterpret_cast<const char*>(&word_num), sizeof(word_num));
+      ofs.write(reinterpret_cast<const char*>(results[i].data()), word_num * sizeof(uint32_t));
+    }
+    ofs.close();
+    if(!ofs || std::rename(temp_path.c_str(), file_path)){
+      std::cerr << "Warning: cannot write cache " << file_path << "\n";
+      std::remove(temp_path.c_str());
+    }
+  }
+
+  const std::vector<uint32_t> *find(const uint64_t hash) const{
+    const auto itr = entries.find(hash);
+    return itr == entries.end() ? nullptr : &itr->second;
+  }
+
+private:
+  std::string file_path;
+  std::vector<uint64_t> railway_hashes;
+  std::vector<std::vector<uint32_t>> railway_results;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> entries;
+};
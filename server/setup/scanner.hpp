@@ -0,0 +1,100 @@
+// calc.cpp と datalink.cpp で共通の入力の読み込み
+#pragma once
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <sys/stat.h>
+
+// 入力全体をバッファに読み込んでから空白区切りのトークンを取り出す
+// 数値は小数点以下の桁数や符号によらず正しく丸めて読む(桁数が多いものは std::from_chars で変換する)
+struct Scanner {
+  explicit Scanner(FILE *fp = stdin) : pos(0){
+    size_t len = 0;
+    struct stat st;
+    // 通常のファイルなら一度で読み込めるようにする
+    if(fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode)) buffer.resize((size_t)st.st_size + 1);
+    else buffer.resize(1 << 20);
+    while(true){
+      const size_t n = std::fread(buffer.data() + len, 1, buffer.size() - len, fp);
+      len += n;
+      if(len < buffer.size()) break;
+      buffer.resize(buffer.size() * 2);
+    }
+    buffer.resize(len);
+  }
+
+  bool eof(){
+    skip_spaces();
+    return pos == buffer.size();
+  }
+
+  std::string_view get_token(){
+    skip_spaces();
+    const size_t start = pos;
+    while(pos < buffer.size() && !is_space(buffer[pos])) pos++;
+    if(start == pos) error("unexpected end of input");
+    return std::string_view(buffer.data() + start, pos - start);
+  }
+
+  std::string get_string(){
+    return std::string(get_token());
+  }
+
+  int get_int(){
+    return get_number<int>();
+  }
+
+  double get_double(){
+    skip_spaces();
+    const char *p = buffer.data() + pos, *last = buffer.data() + buffer.size();
+    const bool negative = p != last && *p == '-';
+    if(negative) p++;
+    uint64_t mantissa = 0;
+    int digits = 0, frac_digits = 0;
+    for(; p != last && '0' <= *p && *p <= '9'; p++, digits++) mantissa = mantissa * 10 + (*p - '0');
+    if(p != last && *p == '.'){
+      for(p++; p != last && '0' <= *p && *p <= '9'; p++, digits++, frac_digits++) mantissa = mantissa * 10 + (*p - '0');
+    }
+    // 仮数と10の累乗がどちらも double で正確に表せるので、1回の除算で正しく丸められる
+    if(0 < digits && digits <= 15 && (p == last || is_space(*p))){
+      pos = p - buffer.data();
+      const double value = mantissa / POW10[frac_digits];
+      return negative ? -value : value;
+    }
+    return get_number<double>();
+  }
+
+private:
+  static constexpr double POW10[16] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+  };
+  std::string buffer;
+  size_t pos;
+
+  static constexpr bool is_space(const char c){
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+  }
+  void skip_spaces(){
+    while(pos < buffer.size() && is_space(buffer[pos])) pos++;
+  }
+
+  template<class T>
+  T get_number(){
+    const std::string_view token = get_token();
+    T value;
+    const auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if(ec != std::errc() || ptr != token.data() + token.size()){
+      error(("invalid number \"" + std::string(token) + "\"").c_str());
+    }
+    return value;
+  }
+
+  [[noreturn]] void error(const char *reason) const{
+    std::cerr << "Error: " << reason << " at byte " << pos << "\n";
+    std::exit(1);
+  }
+};
@@ -0,0 +1,66 @@
+// --stats の計測と出力(calc.cpp と datalink.cpp で共通)
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using StatsClock = std::chrono::steady_clock;
+
+inline double elapsed_ms(const StatsClock::time_point &start, const StatsClock::time_point &end){
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// 処理の段階ごとの経過時間(ms)を順に記録する
+// enabled でなければ時刻を取らず,何も記録しない
+struct PhaseTimer {
+  std::vector<std::pair<std::string, double>> phases;
+
+  explicit PhaseTimer(const bool enabled) : enabled(enabled){
+    if(enabled) start = last = StatsClock::now();
+  }
+
+  // 前回の lap() から今までを name の段階とする
+  void lap(const char *name){
+    if(!enabled) return;
+    const auto now = StatsClock::now();
+    phases.emplace_back(name, elapsed_ms(last, now));
+    last = now;
+  }
+
+  // "phasesMs": { ..., "total": ... } の形で出力する
+  void write_json(std::ostream &os, const char *indent) const{
+    os << indent << "\"phasesMs\": {";
+    for(const auto &[name, ms] : phases) os << " \"" << name << "\": " << ms << ",";
+    os << " \"total\": " << elapsed_ms(start, last) << " }";
+  }
+
+private:
+  bool enabled;
+  StatsClock::time_point start, last;
+};
+
+inline void write_json_string(std::ostream &os, const std::string &s){
+  os << '"';
+  for(const char c : s){
+    if(c == '"' || c == '\\') os << '\\' << c;
+    else if((unsigned char)c < 0x20) os << ' ';
+    else os << c;
+  }
+  os << '"';
+}
+
+// 時間(ms)の大きい順に n 個の番号を返す
+inline std::vector<int> slowest_indices(const std::vector<double> &ms, const int n){
+  std::vector<int> order(ms.size());
+  for(int i = 0; i < (int)ms.size(); i++) order[i] = i;
+  const int k = std::min(n, (int)order.size());
+  std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](const int a, const int b){
+    if(ms[a] != ms[b]) return ms[a] > ms[b];
+    return a < b;
+  });
+  order.resize(k);
+  return order;
+}